@@ -0,0 +1,372 @@
+/**
+ * @file TSP_Bench.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Benchmark driver for the TSP programs. Generates reproducible uniform and clustered
+ * Euclidean instances, runs every solver mode across the requested thread counts and
+ * records wall time, tours/sec, best cost and the gap to the Held-Karp 1-tree bound, computed
+ * by the solver's own heldkarp.c on the matrix file the solvers read.
+ *
+ * Compile:  gcc -Wall -g -fopenmp -o TSP_Bench.o TSP_Bench.c heldkarp.c distance.c arena.c -std=c99 -lm
+ *           (expects TSP_Serial.c and TSP_Parallel.c built as TSP_Serial.o and TSP_Parallel.o)
+ * Usage: ./TSP_Bench.o [-s seed] [-n sizes] [-p threads] [-m modes] [-t seconds] [-o output prefix]
+ *                      [-S serial binary] [-P parallel binary]
+ *        sizes, threads and modes are comma separated, e.g. -n 200,500 -p 1,2,4 -m nn,aco,greedy
+ *        results are written to <output prefix>.csv and <output prefix>.json
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <limits.h>
+#include <math.h>
+#include "arena.h"
+#include "distance.h"
+#include "heldkarp.h"
+
+// Side of the square the cities are placed in
+#define GRID 10000
+
+#define MAX_LIST 32
+
+typedef struct
+{
+    int x;
+    int y;
+} City;
+
+// One solver run as parsed from the program output
+typedef struct
+{
+    double wall;
+    long tours;
+    long cost;
+} RunResult;
+
+// Function to advance a splitmix64 state and return the next 64 random bits
+unsigned long long nextRandom(unsigned long long *state)
+{
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Function to return a uniform random number in [0, 1)
+double uniformRandom(unsigned long long *state)
+{
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Function to return a standard normal random number (Box-Muller)
+double normalRandom(unsigned long long *state)
+{
+    double u = uniformRandom(state);
+    double v = uniformRandom(state);
+    return sqrt(-2.0 * log(1.0 - u)) * cos(6.283185307179586 * v);
+}
+
+// Function to place n cities uniformly at random, or around n / 100 gaussian cluster centres
+void generateCities(City *cities, int n, int clustered, unsigned long long seed)
+{
+    unsigned long long state = seed;
+
+    if (!clustered)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            cities[i].x = (int)(uniformRandom(&state) * GRID);
+            cities[i].y = (int)(uniformRandom(&state) * GRID);
+        }
+        return;
+    }
+
+    int centres = n / 100 > 2 ? n / 100 : 2;
+    double sigma = GRID / (6.0 * sqrt(centres));
+    City *centre = malloc(centres * sizeof(City));
+    for (int c = 0; c < centres; c++)
+    {
+        centre[c].x = (int)(uniformRandom(&state) * GRID);
+        centre[c].y = (int)(uniformRandom(&state) * GRID);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int c = (int)(uniformRandom(&state) * centres);
+        double x = centre[c].x + sigma * normalRandom(&state);
+        double y = centre[c].y + sigma * normalRandom(&state);
+        cities[i].x = (int)fmin(fmax(x, 0), GRID - 1);
+        cities[i].y = (int)fmin(fmax(y, 0), GRID - 1);
+    }
+    free(centre);
+}
+
+// Function to build the rounded Euclidean distance matrix
+int **buildDistances(const City *cities, int n)
+{
+    int **distances = malloc(n * sizeof(int *));
+    distances[0] = malloc((size_t)n * n * sizeof(int));
+
+#pragma omp parallel for
+    for (int i = 0; i < n; i++)
+    {
+        distances[i] = distances[0] + (size_t)i * n;
+        for (int j = 0; j < n; j++)
+        {
+            distances[i][j] = (int)lround(hypot(cities[i].x - cities[j].x, cities[i].y - cities[j].y));
+        }
+    }
+    return distances;
+}
+
+// Function to write the distance matrix and the coordinates in the formats the solvers read
+int writeInstance(int **distances, const City *cities, int n, const char *matrix_file, const char *cities_file)
+{
+    FILE *file = fopen(matrix_file, "w");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            fprintf(file, j == n - 1 ? "%d\n" : "%d,", distances[i][j]);
+        }
+    }
+    fclose(file);
+
+    file = fopen(cities_file, "w");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(file, "%d,%d\n", cities[i].x, cities[i].y);
+    }
+    fclose(file);
+
+    return 1;
+}
+
+// Function to compute a nearest neighbour tour cost, used as the upper bound for the subgradient steps
+long nearestNeighborCost(int **distances, int n)
+{
+    char *visited = calloc(n, sizeof(char));
+    long cost = 0;
+    int currCity = 0;
+
+    visited[0] = 1;
+    for (int step = 1; step < n; step++)
+    {
+        int next = -1;
+        for (int j = 0; j < n; j++)
+        {
+            if (!visited[j] && (next < 0 || distances[currCity][j] < distances[currCity][next]))
+            {
+                next = j;
+            }
+        }
+        cost += distances[currCity][next];
+        visited[next] = 1;
+        currCity = next;
+    }
+    free(visited);
+
+    return cost + distances[currCity][0];
+}
+
+// Function to run one solver binary and parse its cost and tour count
+int runSolver(const char *binary, int threads, const char *mode, const char *matrix_file, const char *cities_file, int seconds, RunResult *result)
+{
+    char command[1024], line[256];
+
+    if (mode == NULL)
+        snprintf(command, sizeof(command), "%s %d -f %s -t %d", binary, threads, matrix_file, seconds);
+    else
+        snprintf(command, sizeof(command), "%s %d -m %s -f %s -c %s -t %d", binary, threads, mode, matrix_file, cities_file, seconds);
+
+    result->cost = -1;
+    result->tours = 0;
+
+    double start = omp_get_wtime();
+    FILE *pipe = popen(command, "r");
+    if (pipe == NULL)
+    {
+        return 0;
+    }
+    // Tour listings can be very long, only the start of each line matters
+    while (fgets(line, sizeof(line), pipe) != NULL)
+    {
+        sscanf(line, "Minimum cost: %ld", &result->cost);
+        sscanf(line, "Tours constructed: %ld", &result->tours);
+    }
+    int status = pclose(pipe);
+    result->wall = omp_get_wtime() - start;
+
+    return status == 0 && result->cost >= 0;
+}
+
+// Function to split a comma separated list of integers
+int parseIntList(char *text, int *values)
+{
+    int count = 0;
+    for (char *item = strtok(text, ","); item != NULL && count < MAX_LIST; item = strtok(NULL, ","))
+    {
+        values[count++] = strtol(item, NULL, 10);
+    }
+    return count;
+}
+
+// Function to split a comma separated list of names
+int parseNameList(char *text, char **values)
+{
+    int count = 0;
+    for (char *item = strtok(text, ","); item != NULL && count < MAX_LIST; item = strtok(NULL, ","))
+    {
+        values[count++] = item;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long seed = 1;
+    int sizes[MAX_LIST] = {200, 500, 1000};
+    int size_count = 3;
+    int threads[MAX_LIST] = {1, 2, 4};
+    int thread_count = 3;
+    char default_modes[] = "nn,aco,greedy,mst,hilbert";
+    char *modes[MAX_LIST];
+    int mode_count = parseNameList(default_modes, modes);
+    int seconds = 5;
+    const char *output = "tsp_bench";
+    const char *serial_binary = "./TSP_Serial.o";
+    const char *parallel_binary = "./TSP_Parallel.o";
+    const char *kinds[] = {"uniform", "clustered"};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            printf("Missing value for %s.\n", argv[i]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-s") == 0)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-n") == 0)
+            size_count = parseIntList(argv[++i], sizes);
+        else if (strcmp(argv[i], "-p") == 0)
+            thread_count = parseIntList(argv[++i], threads);
+        else if (strcmp(argv[i], "-m") == 0)
+            mode_count = parseNameList(argv[++i], modes);
+        else if (strcmp(argv[i], "-t") == 0)
+            seconds = strtol(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-o") == 0)
+            output = argv[++i];
+        else if (strcmp(argv[i], "-S") == 0)
+            serial_binary = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0)
+            parallel_binary = argv[++i];
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    char csv_name[256], json_name[256];
+    snprintf(csv_name, sizeof(csv_name), "%s.csv", output);
+    snprintf(json_name, sizeof(json_name), "%s.json", output);
+    FILE *csv = fopen(csv_name, "w");
+    FILE *json = fopen(json_name, "w");
+    if (csv == NULL || json == NULL)
+    {
+        printf("Error opening output files.\n");
+        return 1;
+    }
+    fprintf(csv, "instance,kind,cities,seed,program,mode,threads,wall_s,tours,tours_per_s,cost,bound,gap_pct\n");
+    fprintf(json, "[");
+    int records = 0;
+
+    for (int s = 0; s < size_count; s++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            int n = sizes[s];
+            char instance[128], matrix_file[192], cities_file[192];
+            snprintf(instance, sizeof(instance), "bench_%s_n%d_s%llu", kinds[k], n, seed);
+            snprintf(matrix_file, sizeof(matrix_file), "%s.csv", instance);
+            snprintf(cities_file, sizeof(cities_file), "%s_cities.csv", instance);
+
+            City *cities = malloc(n * sizeof(City));
+            generateCities(cities, n, k, seed * 1000003ULL + n * 2 + k);
+            int **distances = buildDistances(cities, n);
+            if (!writeInstance(distances, cities, n, matrix_file, cities_file))
+            {
+                printf("Error writing %s.\n", matrix_file);
+                return 1;
+            }
+
+            // Run the bound the parallel solver stops against to the end, on the table it reads
+            DistanceTable table;
+            Arena arena;
+            HeldKarpBound hk;
+            int hk_threads = omp_get_max_threads();
+            double start = omp_get_wtime();
+            if (distanceTableLoad(&table, matrix_file) != n || arenaInit(&arena, heldKarpBytes(n, hk_threads)) != 0)
+            {
+                printf("Error loading %s.\n", matrix_file);
+                return 1;
+            }
+            heldKarpInit(&hk, &table, &arena);
+            long upper = nearestNeighborCost(distances, n);
+            while (!hk.done)
+            {
+                heldKarpStep(&hk, upper, hk_threads);
+            }
+            long bound = heldKarpValue(&hk);
+            printf("\n%s: %d cities, Held-Karp bound %ld (%.2fs)\n", instance, n, bound, omp_get_wtime() - start);
+
+            // The serial program only has nearest neighbour; run it once, then every parallel mode
+            int runs = 1 + mode_count * thread_count;
+            for (int r = 0; r < runs; r++)
+            {
+                const char *program = r == 0 ? "serial" : "parallel";
+                const char *mode = r == 0 ? NULL : modes[(r - 1) / thread_count];
+                int t = r == 0 ? 1 : threads[(r - 1) % thread_count];
+                RunResult result;
+
+                if (!runSolver(r == 0 ? serial_binary : parallel_binary, t, mode, matrix_file, cities_file, seconds, &result))
+                {
+                    printf("  %-8s %-8s %3d threads: failed\n", program, mode ? mode : "nn", t);
+                    continue;
+                }
+
+                double gap = heldKarpGap(&hk, result.cost);
+                double rate = result.tours / result.wall;
+                printf("  %-8s %-8s %3d threads: cost %ld, gap %.2f%%, %.2fs, %.1f tours/s\n", program, mode ? mode : "nn", t, result.cost, gap, result.wall, rate);
+
+                fprintf(csv, "%s,%s,%d,%llu,%s,%s,%d,%.4f,%ld,%.2f,%ld,%ld,%.4f\n", instance, kinds[k], n, seed, program, mode ? mode : "nn", t, result.wall, result.tours, rate, result.cost, bound, gap);
+                fprintf(json, "%s\n  {\"instance\": \"%s\", \"kind\": \"%s\", \"cities\": %d, \"seed\": %llu, \"program\": \"%s\", \"mode\": \"%s\", \"threads\": %d, "
+                              "\"wall_s\": %.4f, \"tours\": %ld, \"tours_per_s\": %.2f, \"cost\": %ld, \"bound\": %ld, \"gap_pct\": %.4f}",
+                        records++ ? "," : "", instance, kinds[k], n, seed, program, mode ? mode : "nn", t, result.wall, result.tours, rate, result.cost, bound, gap);
+            }
+
+            arenaFree(&arena);
+            distanceTableFree(&table);
+            free(distances[0]);
+            free(distances);
+            free(cities);
+        }
+    }
+
+    fprintf(json, "\n]\n");
+    fclose(csv);
+    fclose(json);
+
+    printf("\nResults written to %s and %s\n", csv_name, json_name);
+
+    return 0;
+}
@@ -2,9 +2,31 @@
  * @file tsp.c
  * @authors Camp Steiner, Jeff Luong
  *
- * Compile:  gcc -Wall -g -fopenmp -o tsp.o tsp.c -std=c99 -lm
- * Usage: ./tsp.o <number of threads>
+ * Compile:  gcc -Wall -g -fopenmp -o tsp.o tsp.c arena.c trace.c distance.c heldkarp.c -std=c99 -lm
+ * Usage: ./tsp.o <number of threads> [-m nn|aco|greedy|mst|hilbert|cluster] [-f distance matrix csv]
+ *                                     [-c city coordinates csv] [-t seconds] [-s seed [-i rounds]]
+ *                                     [-T trace json] [-b gap percent] [-k cities per cluster]
+ *        -s makes the run deterministic: every tour draws from its own Philox stream keyed by the
+ *        seed and the tour index, and a fixed number of rounds replaces the time budget
+ *        hilbert reads the city coordinates (x,y per line) from Cities1000.csv unless -c is given
+ *        cluster is for instances too large for a distance matrix: it reads only the coordinates,
+ *        computes distances on demand, splits the cities into k-medoids clusters of about -k
+ *        cities, solves them in parallel and joins them in the order of a tour over the clusters
+ *        ./tsp.o <number of threads> -g <city coordinates csv> <output> writes the rounded Euclidean
+ *        distances as a packed upper triangle, which -f reads in place of a CSV matrix
+ *        -S <socket path> keeps the instance and best tour after solving and serves updates on a
+ *        Unix socket. A request is a batch of lines ended by "end":
+ *            add <x> <y> | remove <city> | move <city> <x> <y> | edge <city> <city> <distance>
+ *            | tour | shutdown
+ *        and is answered with the repaired tour's cost and the request latency
+ *        Between rounds the solver tightens a Held-Karp lower bound (minimum 1-trees with
+ *        subgradient node penalties) and stops once the best tour is within the -b gap of it,
+ *        by default only when the tour is proven optimal; the final gap is reported
+ *        -T records every thread's phases (loading, tour construction, waits for the best tour
+ *        lock) and its total minDistance scan time, and writes them as a Chrome trace when the
+ *        program ends
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,16 +35,107 @@
 #include <time.h>
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "arena.h"
+#include "trace.h"
+#include "distance.h"
+#include "heldkarp.h"
 
-// Number of cities
-#define N 1000
+// Number of cities, set from the number of columns in the distance matrix
+int N = 0;
+
+// Default input files and time budget in seconds
+#define DISTANCES_FILE "DistanceMatrix1000_v2.csv"
+#define CITIES_FILE "Cities1000.csv"
+#define TIME_LIMIT 60
+#define DETERMINISTIC_ROUNDS 100
 
-// Matrix to store the distances between the cities
-int distances[N][N] = {{0}};
 // int global_visited_cities[N + 1] = {0};
 int *global_visited_cities;
-int global_mincost = 99999999;
+// Cost of the best tour, LONG_MAX until the first one is recorded
+long global_mincost = LONG_MAX;
 int global_count = 0;
+// Number of tours built, used to report construction throughput
+long global_tours = 0;
+// Index of the best tour, ties between equal costs go to the lower index
+long global_best_index = LONG_MAX;
+// Seed for the per-tour random streams
+unsigned long long random_seed;
+
+// Scratch of the solver, sized once per problem by workspaceBytes: the per-thread nearest
+// neighbour buffers for the whole solve, then short-lived buffers taken with a mark and
+// released before returning
+Arena workspace;
+
+// One thread's nearest neighbour buffers, a cache line of its own. visited[c] == stamp marks
+// city c as visited by the current tour, so starting a tour only bumps the stamp
+typedef struct
+{
+    int *tour;
+    int *visited;
+    int *row; // distances from the current city
+    int stamp;
+    char pad[64 - 3 * sizeof(int *) - sizeof(int)];
+} TourScratch;
+TourScratch *tour_scratch;
+
+// Counter-based random stream (Philox4x32-10): the key is the seed, the counter is
+// the tour index plus a draw number, so every tour gets the same numbers on any thread
+typedef struct
+{
+    uint32_t key[2];
+    uint32_t counter[4];
+} RandomStream;
+
+// Construction heuristics that can be selected with -m
+typedef enum
+{
+    MODE_NN,
+    MODE_ACO,
+    MODE_GREEDY,
+    MODE_MST,
+    MODE_HILBERT,
+    MODE_CLUSTER
+} SolverMode;
+
+// Ant colony parameters
+#define ACO_ANTS 64
+#define ACO_ALPHA 1.0
+#define ACO_BETA 2.0
+#define ACO_RHO 0.1
+
+// Server repair: 2-opt moves need one end within REPAIR_WINDOW positions of a changed city,
+// and a request stops after REPAIR_MAX_MOVES improving moves
+#define REPAIR_WINDOW 8
+#define REPAIR_MAX_MOVES 1000
+
+// Percentage gap to the Held-Karp bound at which the solver stops by default
+#define HK_GAP 0.0
+
+// Cluster decomposition: cities per cluster by default, k-medoids rounds, members near the
+// mean tried as the medoid, neighbour list length and 2-opt passes of a cluster's tour, and
+// positions on each side of a seam that 2-opt may change
+#define CLUSTER_CITIES 1000
+#define CLUSTER_ROUNDS 10
+#define CLUSTER_CANDIDATES 16
+#define CLUSTER_NEIGHBORS 8
+#define CLUSTER_PASSES 50
+#define CLUSTER_SEAM 32
+
+// Pheromone, heuristic and combined choice matrices, stored contiguously (N*N)
+double *pheromone;
+double *heuristic;
+double *choice_info;
+// Per-thread scratch for the candidate-probability kernel
+double *aco_mask;
+double *aco_prob;
+// Tours and costs of the ants in the current iteration
+int *ant_tours;
+long *ant_costs;
 
     // Define a structure to represent a city
     typedef struct
@@ -32,61 +145,105 @@ int global_count = 0;
 } City;
 
 // Declare an array of City structures to represent the cities
-City cities[N];
+City *cities;
+
+// Nearest neighbour of every city and the distance to it
+int *nearest_city;
+int *nearest_distance;
+int optimal_city = 0;
+
+// Distances of the instance, in the smallest form that holds them (see distance.h). Hot loops
+// fetch rows and columns of it; distance(i, j) is for the occasional single lookup
+DistanceTable dist_table;
+
+static inline int distance(int i, int j)
+{
+    return distanceAt(&dist_table, i, j);
+}
+
+// Function to read the distance matrix and allocate the per-city arrays. A CSV matrix has
+// as many cities as columns in its first row; a packed file written by -g is detected by
+// its header
+int loadDistances(const char *filename)
+{
+    N = distanceTableLoad(&dist_table, filename);
+    if (N == 0)
+    {
+        return 0;
+    }
+
+    cities = calloc(N, sizeof(City));
+    nearest_city = malloc(N * sizeof(int));
+    nearest_distance = malloc(N * sizeof(int));
+    global_visited_cities = malloc((N + 1) * sizeof(int));
+
+    return N;
+}
 
 // Function to calculate the distance between two cities
 double calculateDistance(City city1, City city2)
 {
-    double distance = sqrt(pow(city1.x - city2.x, 2) + pow(city1.y - city2.y, 2));
-    return distance;
+    double dx = city1.x - city2.x;
+    double dy = city1.y - city2.y;
+    return sqrt(dx * dx + dy * dy);
 }
 
-// Function to find the minimum distance from each city to the next closest city
-int findOptimalStartingCity()
+// Function to find each city's nearest neighbour and the closest pair's starting city,
+// done once after the distance matrix is loaded
+void precomputeNearestNeighbors(int thread_count)
 {
-    // Initialize the minimum distance and index of the optimal starting city
-    double minDistance = DBL_MAX;
-    int minIndex = 0;
-    // Loop through all cities
-    for (int i = 0; i < N; i++)
+#pragma omp parallel num_threads(thread_count)
     {
-        // Initialize the minimum distance to the next closest city
-        double minNextDistance = DBL_MAX;
+        int *row = malloc(N * sizeof(int));
 
-        // Loop through all other cities
-        for (int j = 0; j < N; j++)
+#pragma omp for
+        for (int i = 0; i < N; i++)
         {
-            // Skip the current city
-            if (i == j)
-                continue;
+            int minNextDistance = INT_MAX;
+            int minNextIndex = i;
 
-            // Calculate the distance between the two cities
-            double distance = calculateDistance(cities[i], cities[j]);
-
-            // Update the minimum distance to the next closest city
-            if (distance < minNextDistance)
+            distanceRow(&dist_table, i, 0, N, row);
+            for (int j = 0; j < N; j++)
             {
-                minNextDistance = distance;
+                // Skip the current city
+                if (i == j)
+                    continue;
+
+                if (row[j] < minNextDistance)
+                {
+                    minNextDistance = row[j];
+                    minNextIndex = j;
+                }
             }
+
+            nearest_distance[i] = minNextDistance;
+            nearest_city[i] = minNextIndex;
         }
 
-        // Update the minimum distance and index of the optimal starting city
-        if (minNextDistance < minDistance)
+        free(row);
+    }
+}
+
+// Function to find the optimal starting city, the one with the closest next city, once the
+// nearest neighbours are known. The tours read it from optimal_city
+int findOptimalStartingCity()
+{
+    optimal_city = 0;
+    for (int i = 1; i < N; i++)
+    {
+        if (nearest_distance[i] < nearest_distance[optimal_city])
         {
-            minDistance = minNextDistance;
-            minIndex = i;
+            optimal_city = i;
         }
     }
-
-    // Return the index of the optimal starting city
-    return minIndex;
+    return optimal_city;
 }
 
 
 
-// Function to find the minimum distance between the current city
-// and the remaining cities
-int minDistance(int currCity, int visited[N], int optimalCity)
+// Function to find the minimum distance between the current city, whose distances are in
+// row, and the remaining cities
+int minDistance(const int *row, const int *visited, int stamp, int optimalCity)
 {
     // Store the minimum distance and the index of the next city
     int min = INT_MAX;
@@ -96,13 +253,13 @@ int minDistance(int currCity, int visited[N], int optimalCity)
     for (int i = 0; i < N; i++)
     {
         // Check if the city has not been visited and is not the starting city
-        if (visited[i] == 0 && i != optimalCity)
+        if (visited[i] != stamp && i != optimalCity)
         {
             // Check if the distance is less than the minimum
-            if (distances[currCity][i] < min)
+            if (row[i] < min)
             {
                 // Update the minimum distance and the index of the next city
-                min = distances[currCity][i];
+                min = row[i];
                 minIndex = i;
             }
         }
@@ -112,152 +269,2050 @@ int minDistance(int currCity, int visited[N], int optimalCity)
     return minIndex;
 }
 
-// Function to find the minimum cost of traveling to all cities
-int findMinCost(int visited[N])
+// Tour evaluation. A tour is N + 1 cities with tour[N] == tour[0]. TourEval follows a tour of
+// any n of the cities and keeps the position of each and prefix costs along the tour in both
+// directions, so the cost of
+// any stretch of the tour, walked either way, and with it the change made by a move, comes out
+// of a few lookups; after a move only the prefixes from the first changed position on are rebuilt
+typedef struct
 {
-    int local_minCost = 0;
-    int optimalCity = findOptimalStartingCity();
-    int currCity = optimalCity;
-    int local_visited_cities[N];
-    int local_count = 1;
+    int n;
+    int capacity;  // cities the arrays have room for
+    int *tour;
+    int *position; // indexed by city, for the n cities on the tour
+    long *forward;  // forward[k]: cost of tour[0] -> ... -> tour[k]
+    long *backward; // backward[k]: cost of tour[k] -> ... -> tour[0]
+} TourEval;
 
-    for (int i = 0; i < N; i++)
+// Function to compute the cost of a closed tour of N + 1 cities
+long tourCost(const int *tour)
+{
+    return distanceTourCost(&dist_table, tour, N);
+}
+
+// Function to check that a tour visits every city exactly once and returns to its start
+int validateTour(const int *tour)
+{
+    size_t mark = arenaMark(&workspace);
+    uint64_t *seen = arenaCalloc(&workspace, (N + 63) / 64 * sizeof(uint64_t));
+    int valid = tour[N] == tour[0];
+    for (int i = 0; i < N && valid; i++)
     {
-        visited[i] = 0;
+        int city = tour[i];
+        if (city < 0 || city >= N || (seen[city / 64] >> (city % 64) & 1))
+        {
+            valid = 0;
+        }
+        else
+        {
+            seen[city / 64] |= 1ULL << (city % 64);
+        }
     }
+    arenaRelease(&workspace, mark);
+    return valid;
+}
 
-    for (int i = 0; i < N; i++)
+// Function to rebuild the positions and prefix costs from position first onwards
+void tourEvalRefresh(TourEval *eval, int first)
+{
+    if (first == 0)
+    {
+        eval->forward[0] = 0;
+        eval->backward[0] = 0;
+        first = 1;
+    }
+    for (int k = first; k <= eval->n; k++)
+    {
+        eval->forward[k] = eval->forward[k - 1] + distance(eval->tour[k - 1], eval->tour[k]);
+        eval->backward[k] = eval->backward[k - 1] + distance(eval->tour[k], eval->tour[k - 1]);
+    }
+    for (int k = first - 1; k < eval->n; k++)
+    {
+        eval->position[eval->tour[k]] = k;
+    }
+}
+
+// Function to set up the evaluation of a copy of a closed tour of n cities
+void tourEvalInit(TourEval *eval, const int *tour, int n)
+{
+    eval->n = n;
+    eval->capacity = N;
+    eval->tour = malloc((N + 1) * sizeof(int));
+    eval->position = malloc(N * sizeof(int));
+    eval->forward = malloc((N + 1) * sizeof(long));
+    eval->backward = malloc((N + 1) * sizeof(long));
+    memcpy(eval->tour, tour, (n + 1) * sizeof(int));
+    tourEvalRefresh(eval, 0);
+}
+
+// Function to make room for capacity cities, numbered below capacity
+void tourEvalReserve(TourEval *eval, int capacity)
+{
+    eval->capacity = capacity;
+    eval->tour = realloc(eval->tour, (capacity + 1) * sizeof(int));
+    eval->position = realloc(eval->position, capacity * sizeof(int));
+    eval->forward = realloc(eval->forward, (capacity + 1) * sizeof(long));
+    eval->backward = realloc(eval->backward, (capacity + 1) * sizeof(long));
+}
+
+void tourEvalFree(TourEval *eval)
+{
+    free(eval->tour);
+    free(eval->position);
+    free(eval->forward);
+    free(eval->backward);
+}
+
+// Function to return the cost of the whole tour
+long tourEvalCost(const TourEval *eval)
+{
+    return eval->forward[eval->n];
+}
+
+// Function to return the cost of walking positions i..j (i <= j) forwards, or backwards from j to i
+long tourEvalSegment(const TourEval *eval, int i, int j, int reversed)
+{
+    return reversed ? eval->backward[j] - eval->backward[i] : eval->forward[j] - eval->forward[i];
+}
+
+// Function to return the change in cost from reversing positions i..j (0 < i <= j < n), given
+// the costs of the two edges it adds, d(tour[i - 1], tour[j]) and d(tour[i], tour[j + 1])
+long tourEvalTwoOptDelta(const TourEval *eval, int i, int j, int join_left, int join_right)
+{
+    long before = tourEvalSegment(eval, i - 1, j + 1, 0);
+    long after = join_left + tourEvalSegment(eval, i, j, 1) + join_right;
+    return after - before;
+}
+
+// Function to reverse positions i..j and refresh the prefixes they change
+void tourEvalApplyTwoOpt(TourEval *eval, int i, int j)
+{
+    for (int a = i, b = j; a < b; a++, b--)
+    {
+        int temp = eval->tour[a];
+        eval->tour[a] = eval->tour[b];
+        eval->tour[b] = temp;
+    }
+    tourEvalRefresh(eval, i);
+}
+
+// Function to replace the global best with a closed tour if it is cheaper
+void updateBestTour(const int *tour, long cost, long tour_index)
+{
+    traceBegin("updateBestTour wait");
+#pragma omp critical
+{
+    traceEnd();
+    traceBegin("updateBestTour");
+    if (cost < global_mincost || (cost == global_mincost && tour_index < global_best_index))
+    {
+        global_mincost = cost;
+        memcpy(global_visited_cities, tour, (N + 1) * sizeof(int));
+        global_count = N + 1;
+        global_best_index = tour_index;
+    }
+    traceEnd();
+}
+}
+
+// Function to size the workspace for a solve on thread_count threads: the tour scratch of
+// every thread, then room for the buffers taken while checking the result
+size_t workspaceBytes(int thread_count)
+{
+    size_t per_thread = sizeof(TourScratch) + (3 * (size_t)N + 1) * sizeof(int) + 3 * ARENA_ALIGN;
+    return thread_count * per_thread + heldKarpBytes(N, thread_count) + (N + 63) / 64 * sizeof(uint64_t) + 2 * ARENA_ALIGN;
+}
+
+// Function to find the minimum cost of traveling to all cities
+long findMinCost(TourScratch *scratch, int optimalCity, long tour_index)
+{
+    traceBegin("findMinCost");
+    int currCity = optimalCity;
+    int *local_visited_cities = scratch->tour;
+    int *visited = scratch->visited;
+    double scan_time = 0;
+
+    // A new stamp unmarks every city; clear the marks only when the stamps run out
+    if (++scratch->stamp == INT_MAX)
     {
-        local_visited_cities[i] = 0;
+        memset(visited, 0, N * sizeof(int));
+        scratch->stamp = 1;
     }
+    int stamp = scratch->stamp;
 
     for (int i = 0; i < N; i++)
     {
         // printf("i = %d, city = %d\n", i, currCity);
-        visited[currCity] = 1;
+        visited[currCity] = stamp;
         local_visited_cities[i] = currCity;
-        local_count++;
 
-        // Find the next closest city
-        int nextCity = minDistance(currCity, visited, optimalCity);
+        // Move to the next closest city
+        if (i < N - 1)
+        {
+            double scan = traceNow();
+            distanceRow(&dist_table, currCity, 0, N, scratch->row);
+            currCity = minDistance(scratch->row, visited, stamp, optimalCity);
+            scan_time += traceNow() - scan;
+        }
+    }
+    // Too many scans per tour for an event each, so the trace gets their total per thread
+    traceAdd("minDistance", scan_time);
+
+    // Close the tour at the starting city
+    local_visited_cities[N] = optimalCity;
 
-        // Add the distance to the minimum cost
-        local_minCost += distances[currCity][nextCity];
+    updateBestTour(local_visited_cities, tourCost(local_visited_cities), tour_index);
 
-        // Move to the next city
-        currCity = nextCity;
-    }
+#pragma omp atomic
+    global_tours++;
 
-    // Add the distance from the last city to the starting city
-    local_minCost += distances[currCity][0];
+    traceEnd();
+    return global_mincost;
+}
 
-    // Set the visited flah for the starting city to 1
-    visited[0] = 1;
+// Function to compute one Philox4x32-10 block
+void philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
 
-    // Find the next closest cty (which should be the starting city)
-    int nextCity = minDistance(currCity, visited, optimalCity);
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
 
-    // Add the distance from the last city to the starting city
-    local_minCost += distances[currCity][nextCity];
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
 
-    // Move to the starting city
-    currCity = nextCity;
+// Function to start the random stream of a tour
+void initStream(RandomStream *stream, long tour_index)
+{
+    stream->key[0] = (uint32_t)random_seed;
+    stream->key[1] = (uint32_t)(random_seed >> 32);
+    stream->counter[0] = 0;
+    stream->counter[1] = 0;
+    stream->counter[2] = (uint32_t)tour_index;
+    stream->counter[3] = (uint32_t)((uint64_t)tour_index >> 32);
+}
 
-#pragma omp critical
+// Function to draw the next number in [0, 1) from a tour's stream
+double streamRandom(RandomStream *stream)
 {
-    if (local_minCost < global_mincost)
+    uint32_t out[4];
+    philox(stream->counter, stream->key, out);
+    if (++stream->counter[0] == 0)
     {
-        global_mincost = local_minCost;
-        memcpy(global_visited_cities, local_visited_cities, sizeof(local_visited_cities));
-        global_count = local_count;
+        stream->counter[1]++;
     }
+    return ((((uint64_t)out[0] << 32) | out[1]) >> 11) * (1.0 / 9007199254740992.0);
 }
 
-    return global_mincost;
+// Function to pick the starting city of a nearest neighbour tour: tour 0 starts at the
+// optimal starting city, the others start at a city drawn from their own stream
+int tourStartCity(long tour_index)
+{
+    if (tour_index == 0)
+    {
+        return optimal_city;
+    }
+
+    RandomStream stream;
+    initStream(&stream, tour_index);
+    return (int)(streamRandom(&stream) * N);
 }
 
-int main(int argc, char *argv[])
+// Function to read city coordinates ("x,y" per line) into the cities array
+int loadCities(const char *filename)
 {
-    int thread_count = strtol(argv[1], NULL, 10);
-    char buffer[8192];
-    char *record, *line;
-    int i = 0, j = 0;
-    global_visited_cities = malloc(1001 * sizeof(int));
+    char buffer[256];
+    int count = 0;
 
-    clock_t start = clock(); // Start the time to time reading the file and the computation
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
 
-    FILE *file;
-    // Read file
-    file = fopen("DistanceMatrix1000_v2.csv", "r");
+    while (count < N && fgets(buffer, sizeof(buffer), file) != NULL)
+    {
+        char *record = strtok(buffer, ",");
+        if (record == NULL)
+        {
+            continue;
+        }
+        cities[count].x = atoi(record);
+        record = strtok(NULL, ",");
+        cities[count].y = record != NULL ? atoi(record) : 0;
+        count++;
+    }
 
-    // If there is an error in opeing the file, print an error
+    fclose(file);
+    return count;
+}
+
+// Function to set N to the number of cities in a coordinate file and read them
+int loadCoordinates(const char *filename)
+{
+    char buffer[256];
+    FILE *file = fopen(filename, "r");
     if (file == NULL)
     {
-        printf("Error opening file.\n");
-        return 1;
+        return 0;
+    }
+    N = 0;
+    while (fgets(buffer, sizeof(buffer), file) != NULL)
+    {
+        if (strpbrk(buffer, "0123456789") != NULL)
+            N++;
+    }
+    fclose(file);
+
+    cities = calloc(N, sizeof(City));
+    if (N < 2 || loadCities(filename) < N)
+    {
+        return 0;
+    }
+    return N;
+}
+
+// Function to load an instance from its coordinates alone, with a geometric distance table
+int loadGeometricDistances(const char *filename)
+{
+    if (loadCoordinates(filename) == 0)
+    {
+        return 0;
+    }
+    distanceTableGeometric(&dist_table, N);
+    for (int i = 0; i < N; i++)
+    {
+        dist_table.x[i] = cities[i].x;
+        dist_table.y[i] = cities[i].y;
+    }
+    nearest_city = malloc(N * sizeof(int));
+    nearest_distance = malloc(N * sizeof(int));
+    global_visited_cities = malloc((N + 1) * sizeof(int));
+
+    return N;
+}
+
+// Function to turn a city coordinate file into a packed distance file. Only the upper triangle
+// is computed: rows are shared out dynamically since they shrink, and each row's inner loop is
+// a SIMD sqrt(dx * dx + dy * dy) rounded to the nearest integer
+int generateDistances(const char *cities_file, const char *output_file, int thread_count)
+{
+    if (loadCoordinates(cities_file) == 0)
+    {
+        return 0;
+    }
+
+    double *xs = malloc(N * sizeof(double));
+    double *ys = malloc(N * sizeof(double));
+    double min_x = cities[0].x, max_x = cities[0].x, min_y = cities[0].y, max_y = cities[0].y;
+    for (int i = 0; i < N; i++)
+    {
+        xs[i] = cities[i].x;
+        ys[i] = cities[i].y;
+        min_x = fmin(min_x, xs[i]);
+        max_x = fmax(max_x, xs[i]);
+        min_y = fmin(min_y, ys[i]);
+        max_y = fmax(max_y, ys[i]);
     }
 
-    while ((line = fgets(buffer, sizeof(buffer), file)) != NULL)
+    // No distance is longer than the bounding box diagonal
+    distanceTableAlloc(&dist_table, N, 1, hypot(max_x - min_x, max_y - min_y) + 0.5 > UINT16_MAX);
+
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 16)
+    for (int i = 0; i < N; i++)
     {
-        j = 0;
-        record = strtok(line, ",");
-        while (record != NULL)
+        double x = xs[i], y = ys[i];
+        long row = dist_table.row[i];
+        if (distanceWide(&dist_table))
         {
-            // Place record in array
-            distances[i][j] = atoi(record);
-            j++;
-            record = strtok(NULL, ",");
+            uint32_t *out = dist_table.d32 + row;
+#pragma omp simd
+            for (int j = i; j < N; j++)
+            {
+                double dx = xs[j] - x, dy = ys[j] - y;
+                out[j] = (uint32_t)(sqrt(dx * dx + dy * dy) + 0.5);
+            }
         }
-        i++;
-        if (i == 1000)
+        else
         {
-            // printf("%d \n", i);
-            // printf("%d \n", j);
-            break;
+            uint16_t *out = dist_table.d16 + row;
+#pragma omp simd
+            for (int j = i; j < N; j++)
+            {
+                double dx = xs[j] - x, dy = ys[j] - y;
+                out[j] = (uint16_t)(sqrt(dx * dx + dy * dy) + 0.5);
+            }
         }
     }
+    free(xs);
+    free(ys);
 
-    fclose(file);
+    return distanceTableWrite(&dist_table, output_file) == 0 ? N : 0;
+}
 
-    // printf("\n\nThe cost list is:");
+// Candidate edge for the greedy-edge constructor
+typedef struct
+{
+    int cost;
+    int from;
+    int to;
+} Edge;
 
-    // for (i = 0; i < N; i++)
-    // {
-    //     printf("\n");
+// Function to order edges by cost, breaking ties by endpoints so the result is deterministic
+int compareEdges(const void *a, const void *b)
+{
+    const Edge *x = a, *y = b;
+    if (x->cost != y->cost)
+        return x->cost < y->cost ? -1 : 1;
+    if (x->from != y->from)
+        return x->from < y->from ? -1 : 1;
+    return (x->to > y->to) - (x->to < y->to);
+}
 
-    //     for (j = 0; j < N; j++)
-    //         printf("%d ", distances[i][j]);
-    // }
-    // printf("\n");
+// Function to sort an array in parallel: each thread sorts a chunk, then chunks are merged pairwise
+void parallelSort(void *base, size_t count, size_t size, int (*compare)(const void *, const void *), int thread_count)
+{
+    char *buffer = malloc(count * size);
+    char *data = base;
+    char *scratch = buffer;
+    size_t chunk = (count + thread_count - 1) / thread_count;
+
+#pragma omp parallel for num_threads(thread_count)
+    for (int t = 0; t < thread_count; t++)
+    {
+        size_t lo = t * chunk;
+        size_t hi = lo + chunk < count ? lo + chunk : count;
+        if (lo < hi)
+        {
+            qsort(data + lo * size, hi - lo, size, compare);
+        }
+    }
+
+    for (size_t width = chunk; width < count; width *= 2)
+    {
+        long pairs = (long)((count + 2 * width - 1) / (2 * width));
+
+#pragma omp parallel for num_threads(thread_count)
+        for (long p = 0; p < pairs; p++)
+        {
+            size_t lo = p * 2 * width;
+            size_t mid = lo + width < count ? lo + width : count;
+            size_t hi = mid + width < count ? mid + width : count;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi)
+            {
+                if (compare(data + j * size, data + i * size) < 0)
+                    memcpy(scratch + (k++) * size, data + (j++) * size, size);
+                else
+                    memcpy(scratch + (k++) * size, data + (i++) * size, size);
+            }
+            memcpy(scratch + k * size, data + i * size, (mid - i) * size);
+            k += mid - i;
+            memcpy(scratch + k * size, data + j * size, (hi - j) * size);
+        }
+
+        char *temp = data;
+        data = scratch;
+        scratch = temp;
+    }
+
+    if (data != base)
+    {
+        memcpy(base, data, count * size);
+    }
+    free(buffer);
+}
 
-    while ((clock() - start) / CLOCKS_PER_SEC < 60)
+// Function to find the union-find root of a city with path halving
+int findSet(int *parent, int city)
+{
+    while (parent[city] != city)
     {
-        // Array to keep track of which cities have been visited
-        int visited[N] = {0};
+        parent[city] = parent[parent[city]];
+        city = parent[city];
+    }
+    return city;
+}
 
+// Function to build a tour by repeatedly taking the shortest edge that keeps every degree <= 2
+// and closes no early cycle
+long greedyEdgeTour(int *tour, int thread_count)
+{
+    size_t edge_count = (size_t)N * (N - 1) / 2;
+    Edge *edges = malloc(edge_count * sizeof(Edge));
+    int *parent = malloc(N * sizeof(int));
+    int *degree = calloc(N, sizeof(int));
+    int(*adjacent)[2] = malloc(N * sizeof(*adjacent));
+
+    // Fill the upper triangle, row i starts after the i rows before it
 #pragma omp parallel num_threads(thread_count)
+    {
+        int *row = malloc(N * sizeof(int));
 
-        global_mincost = findMinCost(visited);
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < N; i++)
+        {
+            size_t offset = (size_t)i * (N - 1) - (size_t)i * (i - 1) / 2;
+            distanceRow(&dist_table, i, i + 1, N, row);
+            for (int j = i + 1; j < N; j++)
+            {
+                Edge *e = &edges[offset + (j - i - 1)];
+                e->cost = row[j - i - 1];
+                e->from = i;
+                e->to = j;
+            }
+        }
 
+        free(row);
     }
 
-    printf("Minimum cost: %d\n", global_mincost);
+    parallelSort(edges, edge_count, sizeof(Edge), compareEdges, thread_count);
 
-    printf("The number of cities traversed: %d\n", global_count);
+    for (int i = 0; i < N; i++)
+    {
+        parent[i] = i;
+    }
 
-    printf("The list of cities reversed in order: ");
-    for (i = 0; i < global_count; i++)
+    int taken = 0;
+    for (size_t e = 0; e < edge_count && taken < N - 1; e++)
     {
-        if (i == global_count - 1)
+        int a = edges[e].from, b = edges[e].to;
+        if (degree[a] == 2 || degree[b] == 2)
+            continue;
+
+        int ra = findSet(parent, a), rb = findSet(parent, b);
+        if (ra == rb)
+            continue;
+
+        parent[ra] = rb;
+        adjacent[a][degree[a]++] = b;
+        adjacent[b][degree[b]++] = a;
+        taken++;
+    }
+
+    // The accepted edges form one Hamiltonian path, walk it from an endpoint
+    int currCity = 0;
+    while (degree[currCity] != 1)
+    {
+        currCity++;
+    }
+    int prevCity = -1;
+    for (int i = 0; i < N; i++)
+    {
+        tour[i] = currCity;
+        int nextCity = adjacent[currCity][0] != prevCity ? adjacent[currCity][0] : adjacent[currCity][1];
+        prevCity = currCity;
+        currCity = nextCity;
+    }
+    tour[N] = tour[0];
+
+    free(edges);
+    free(parent);
+    free(degree);
+    free(adjacent);
+
+    return tourCost(tour);
+}
+
+// Function to build a tour by shortcutting a preorder walk of the minimum spanning tree (double-tree)
+long mstTour(int *tour, int thread_count)
+{
+    int *key = malloc(N * sizeof(int));
+    int *parent = malloc(N * sizeof(int));
+    char *in_tree = calloc(N, sizeof(char));
+    int *first_child = malloc(N * sizeof(int));
+    int *next_sibling = malloc(N * sizeof(int));
+    int *stack = malloc(N * sizeof(int));
+    int root = optimal_city;
+
+    for (int i = 0; i < N; i++)
+    {
+        key[i] = INT_MAX;
+        parent[i] = -1;
+    }
+    key[root] = 0;
+
+    // Prim on the dense matrix; every step is a parallel argmin followed by a parallel key update.
+    // Each thread updates its own block of cities from that block of the new city's row
+    int best_city = -1;
+    int *row = malloc(N * sizeof(int));
+#pragma omp parallel num_threads(thread_count)
+    for (int step = 0; step < N; step++)
+    {
+        int local_city = -1;
+        int threads = omp_get_num_threads(), tid = omp_get_thread_num();
+        int lo = (int)((long)N * tid / threads), hi = (int)((long)N * (tid + 1) / threads);
+
+#pragma omp single
+        best_city = -1;
+
+#pragma omp for nowait
+        for (int i = 0; i < N; i++)
         {
-            printf("%d", global_visited_cities[i]);
+            if (!in_tree[i] && (local_city < 0 || key[i] < key[local_city]))
+            {
+                local_city = i;
+            }
         }
-        else {
-            printf("%d->", global_visited_cities[i]);
+
+#pragma omp critical
+        if (local_city >= 0 && (best_city < 0 || key[local_city] < key[best_city] || (key[local_city] == key[best_city] && local_city < best_city)))
+        {
+            best_city = local_city;
         }
-    }
 
-    printf("\n");
+#pragma omp barrier
+
+        int u = best_city;
+
+#pragma omp single
+        in_tree[u] = 1;
+
+        distanceRow(&dist_table, u, lo, hi, &row[lo]);
+        for (int v = lo; v < hi; v++)
+        {
+            if (!in_tree[v] && v != u && row[v] < key[v])
+            {
+                key[v] = row[v];
+                parent[v] = u;
+            }
+        }
+
+#pragma omp barrier
+    }
+
+    // Children lists from the parent array, then an iterative preorder walk
+    for (int i = 0; i < N; i++)
+    {
+        first_child[i] = -1;
+    }
+    for (int i = N - 1; i >= 0; i--)
+    {
+        if (parent[i] >= 0)
+        {
+            next_sibling[i] = first_child[parent[i]];
+            first_child[parent[i]] = i;
+        }
+    }
+
+    int top = 0, count = 0;
+    stack[top++] = root;
+    while (top > 0)
+    {
+        int city = stack[--top];
+        tour[count++] = city;
+
+        // Push children in reverse so the first child is visited first
+        int children = 0;
+        for (int c = first_child[city]; c >= 0; c = next_sibling[c])
+        {
+            stack[top + children++] = c;
+        }
+        for (int a = 0, b = children - 1; a < b; a++, b--)
+        {
+            int temp = stack[top + a];
+            stack[top + a] = stack[top + b];
+            stack[top + b] = temp;
+        }
+        top += children;
+    }
+    tour[N] = tour[0];
+
+    free(key);
+    free(parent);
+    free(in_tree);
+    free(row);
+    free(first_child);
+    free(next_sibling);
+    free(stack);
+
+    return tourCost(tour);
+}
+
+// Function to map a point on a 2^order x 2^order grid to its distance along the Hilbert curve
+unsigned long long hilbertIndex(unsigned int x, unsigned int y, int order)
+{
+    unsigned long long d = 0;
+    for (unsigned int s = 1u << (order - 1); s > 0; s >>= 1)
+    {
+        unsigned int rx = (x & s) > 0;
+        unsigned int ry = (y & s) > 0;
+        d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve stays continuous
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            unsigned int t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+// City paired with its Hilbert curve position
+typedef struct
+{
+    unsigned long long key;
+    int city;
+} CurvePoint;
+
+// Function to order points along the curve
+int compareCurvePoints(const void *a, const void *b)
+{
+    const CurvePoint *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->city - y->city;
+}
+
+// Function to build a tour by visiting the cities in Hilbert space-filling-curve order
+long hilbertTour(int *tour, int thread_count)
+{
+    CurvePoint *points = malloc(N * sizeof(CurvePoint));
+    int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+
+#pragma omp parallel for num_threads(thread_count) reduction(min : min_x, min_y) reduction(max : max_x, max_y)
+    for (int i = 0; i < N; i++)
+    {
+        min_x = cities[i].x < min_x ? cities[i].x : min_x;
+        min_y = cities[i].y < min_y ? cities[i].y : min_y;
+        max_x = cities[i].x > max_x ? cities[i].x : max_x;
+        max_y = cities[i].y > max_y ? cities[i].y : max_y;
+    }
+
+    // Scale the bounding box onto a 2^16 grid
+    double span = fmax(max_x - min_x, max_y - min_y);
+    double scale = span > 0 ? 65535.0 / span : 0;
+
+#pragma omp parallel for num_threads(thread_count)
+    for (int i = 0; i < N; i++)
+    {
+        unsigned int x = (unsigned int)((cities[i].x - min_x) * scale);
+        unsigned int y = (unsigned int)((cities[i].y - min_y) * scale);
+        points[i].key = hilbertIndex(x, y, 16);
+        points[i].city = i;
+    }
+
+    parallelSort(points, N, sizeof(CurvePoint), compareCurvePoints, thread_count);
+
+    for (int i = 0; i < N; i++)
+    {
+        tour[i] = points[i].city;
+    }
+    tour[N] = tour[0];
+
+    free(points);
+
+    return tourCost(tour);
+}
+
+// Function to return the squared distance between two cities, exact in integers
+static inline long long squaredDistance(int i, int j)
+{
+    long long dx = (long long)cities[i].x - cities[j].x, dy = (long long)cities[i].y - cities[j].y;
+    return dx * dx + dy * dy;
+}
+
+// Function to assign every city to its nearest medoid, ties to the lower cluster.
+// Returns the number of cities that changed cluster
+long assignClusters(const int *medoids, int k, int *cluster, int thread_count)
+{
+    long changed = 0;
+#pragma omp parallel for num_threads(thread_count) schedule(static) reduction(+ : changed)
+    for (int i = 0; i < N; i++)
+    {
+        int best = 0;
+        long long best_d = squaredDistance(i, medoids[0]);
+        for (int c = 1; c < k; c++)
+        {
+            long long d = squaredDistance(i, medoids[c]);
+            if (d < best_d)
+            {
+                best_d = d;
+                best = c;
+            }
+        }
+        changed += cluster[i] != best;
+        cluster[i] = best;
+    }
+    return changed;
+}
+
+// Function to group the cities by cluster: the members of cluster c are
+// members[first[c] .. first[c + 1] - 1], in increasing city order
+void clusterMembers(const int *cluster, int k, int *first, int *members)
+{
+    memset(first, 0, (k + 1) * sizeof(int));
+    for (int i = 0; i < N; i++)
+    {
+        first[cluster[i] + 1]++;
+    }
+    for (int c = 0; c < k; c++)
+    {
+        first[c + 1] += first[c];
+    }
+    int *fill = malloc(k * sizeof(int));
+    memcpy(fill, first, k * sizeof(int));
+    for (int i = 0; i < N; i++)
+    {
+        members[fill[cluster[i]]++] = i;
+    }
+    free(fill);
+}
+
+// Function to pick the medoid of m cities: of the CLUSTER_CANDIDATES members nearest the
+// mean, the one with the least total distance to the others. Writes the mean to cx, cy
+int clusterMedoid(const int *members, int m, double *cx, double *cy)
+{
+    const DistanceTable *table = &dist_table;
+    double x = 0, y = 0;
+    for (int a = 0; a < m; a++)
+    {
+        x += cities[members[a]].x;
+        y += cities[members[a]].y;
+    }
+    x /= m;
+    y /= m;
+    *cx = x;
+    *cy = y;
+
+    // Candidates kept sorted by their distance to the mean
+    int candidates[CLUSTER_CANDIDATES];
+    double candidate_d[CLUSTER_CANDIDATES];
+    int count = 0;
+    for (int a = 0; a < m; a++)
+    {
+        double dx = cities[members[a]].x - x, dy = cities[members[a]].y - y;
+        double d = dx * dx + dy * dy;
+        if (count == CLUSTER_CANDIDATES && d >= candidate_d[count - 1])
+            continue;
+        int p = count < CLUSTER_CANDIDATES ? count++ : count - 1;
+        for (; p > 0 && candidate_d[p - 1] > d; p--)
+        {
+            candidates[p] = candidates[p - 1];
+            candidate_d[p] = candidate_d[p - 1];
+        }
+        candidates[p] = members[a];
+        candidate_d[p] = d;
+    }
+
+    int best = members[0];
+    long best_sum = LONG_MAX;
+    for (int c = 0; c < count; c++)
+    {
+        long sum = 0;
+        for (int a = 0; a < m; a++)
+        {
+            sum += distanceGeometric(table, candidates[c], members[a]);
+        }
+        if (sum < best_sum || (sum == best_sum && candidates[c] < best))
+        {
+            best_sum = sum;
+            best = candidates[c];
+        }
+    }
+    return best;
+}
+
+// Function to reverse the cyclic run of positions i..j of a tour of m local cities
+void reverseCyclic(int *t, int *pos, int m, int i, int j)
+{
+    int len = (j - i + m) % m + 1;
+    for (int s = 0; s < len / 2; s++)
+    {
+        int a = (i + s) % m, b = (j - s + m) % m;
+        int temp = t[a];
+        t[a] = t[b];
+        t[b] = temp;
+        pos[t[a]] = a;
+        pos[t[b]] = b;
+    }
+}
+
+// Function to reorder the m cities of a cluster into a closed tour: nearest neighbour from
+// the first member, then 2-opt over the CLUSTER_NEIGHBORS nearest cities of each city
+void solveCluster(int *members, int m)
+{
+    const DistanceTable *table = &dist_table;
+    if (m < 4)
+        return;
+
+    int k = m - 1 < CLUSTER_NEIGHBORS ? m - 1 : CLUSTER_NEIGHBORS;
+    int *t = malloc(m * sizeof(int));
+    int *pos = malloc(m * sizeof(int));
+    int *neighbors = malloc((size_t)m * k * sizeof(int));
+    int *neighbor_d = malloc(k * sizeof(int));
+    char *visited = calloc(m, 1);
+
+    // Nearest neighbour tour in local indices
+    t[0] = 0;
+    visited[0] = 1;
+    for (int s = 1; s < m; s++)
+    {
+        int a = t[s - 1], next = -1, next_d = INT_MAX;
+        for (int b = 0; b < m; b++)
+        {
+            if (!visited[b] && distanceGeometric(table, members[a], members[b]) < next_d)
+            {
+                next_d = distanceGeometric(table, members[a], members[b]);
+                next = b;
+            }
+        }
+        t[s] = next;
+        visited[next] = 1;
+    }
+    for (int s = 0; s < m; s++)
+    {
+        pos[t[s]] = s;
+    }
+
+    // Neighbour lists, nearest first
+    for (int a = 0; a < m; a++)
+    {
+        int *list = &neighbors[(size_t)a * k];
+        int count = 0;
+        for (int b = 0; b < m; b++)
+        {
+            if (b == a)
+                continue;
+            int d = distanceGeometric(table, members[a], members[b]);
+            if (count == k && d >= neighbor_d[k - 1])
+                continue;
+            int p = count < k ? count++ : k - 1;
+            for (; p > 0 && neighbor_d[p - 1] > d; p--)
+            {
+                list[p] = list[p - 1];
+                neighbor_d[p] = neighbor_d[p - 1];
+            }
+            list[p] = b;
+            neighbor_d[p] = d;
+        }
+    }
+
+    // 2-opt: replace edges (a, succ a) and (c, succ c) by (a, c) and (succ a, succ c) for the
+    // neighbours c of a that are closer than succ a
+    int improved = 1;
+    for (int pass = 0; improved && pass < CLUSTER_PASSES; pass++)
+    {
+        improved = 0;
+        for (int p = 0; p < m; p++)
+        {
+            int a = t[p], b = t[(p + 1) % m];
+            int d_ab = distanceGeometric(table, members[a], members[b]);
+            for (int n = 0; n < k; n++)
+            {
+                int c = neighbors[(size_t)a * k + n];
+                int d_ac = distanceGeometric(table, members[a], members[c]);
+                if (d_ac >= d_ab)
+                    break;
+                int q = pos[c], d = t[(q + 1) % m];
+                if (c == b || d == a)
+                    continue;
+                int delta = d_ac + distanceGeometric(table, members[b], members[d]) - d_ab - distanceGeometric(table, members[c], members[d]);
+                if (delta < 0)
+                {
+                    reverseCyclic(t, pos, m, (p + 1) % m, q);
+                    improved = 1;
+                    b = t[(p + 1) % m];
+                    d_ab = distanceGeometric(table, members[a], members[b]);
+                }
+            }
+        }
+    }
+
+    for (int s = 0; s < m; s++)
+    {
+        t[s] = members[t[s]];
+    }
+    memcpy(members, t, m * sizeof(int));
+
+    free(t);
+    free(pos);
+    free(neighbors);
+    free(neighbor_d);
+    free(visited);
+}
+
+// Function to order k cluster centres into a closed tour: nearest neighbour, then 2-opt
+void orderClusters(const double *cx, const double *cy, int k, int *order)
+{
+    char *used = calloc(k, 1);
+    order[0] = 0;
+    used[0] = 1;
+    for (int s = 1; s < k; s++)
+    {
+        int a = order[s - 1], next = -1;
+        double next_d = DBL_MAX;
+        for (int b = 0; b < k; b++)
+        {
+            double d = hypot(cx[a] - cx[b], cy[a] - cy[b]);
+            if (!used[b] && d < next_d)
+            {
+                next_d = d;
+                next = b;
+            }
+        }
+        order[s] = next;
+        used[next] = 1;
+    }
+    free(used);
+
+#define CENTRE_DISTANCE(a, b) hypot(cx[order[a]] - cx[order[b]], cy[order[a]] - cy[order[b]])
+    int improved = k > 3;
+    while (improved)
+    {
+        improved = 0;
+        for (int i = 1; i < k - 1; i++)
+        {
+            for (int j = i + 1; j < k; j++)
+            {
+                int after = (j + 1) % k;
+                double delta = CENTRE_DISTANCE(i - 1, j) + CENTRE_DISTANCE(i, after) - CENTRE_DISTANCE(i - 1, i) - CENTRE_DISTANCE(j, after);
+                if (delta < -1e-9)
+                {
+                    for (int a = i, b = j; a < b; a++, b--)
+                    {
+                        int temp = order[a];
+                        order[a] = order[b];
+                        order[b] = temp;
+                    }
+                    improved = 1;
+                }
+            }
+        }
+    }
+#undef CENTRE_DISTANCE
+}
+
+// Function to run 2-opt on the positions lo .. hi - 1 of a tour, moving only edges that lie
+// inside the window. Returns the number of improving moves
+int seamTwoOpt(int *tour, int lo, int hi)
+{
+    const DistanceTable *table = &dist_table;
+    int moves = 0;
+    int improved = 1;
+    while (improved)
+    {
+        improved = 0;
+        for (int i = lo + 1; i < hi - 2; i++)
+        {
+            for (int j = i + 1; j < hi - 1; j++)
+            {
+                int delta = distanceGeometric(table, tour[i - 1], tour[j]) + distanceGeometric(table, tour[i], tour[j + 1]) - distanceGeometric(table, tour[i - 1], tour[i]) - distanceGeometric(table, tour[j], tour[j + 1]);
+                if (delta < 0)
+                {
+                    for (int a = i, b = j; a < b; a++, b--)
+                    {
+                        int temp = tour[a];
+                        tour[a] = tour[b];
+                        tour[b] = temp;
+                    }
+                    improved = 1;
+                    moves++;
+                }
+            }
+        }
+    }
+    return moves;
+}
+
+// Function to build a tour by decomposition: alternating k-medoids splits the cities into
+// clusters of about cluster_cities, every cluster gets its own tour in parallel, a tour over
+// the cluster centres orders them, and the cluster tours are cut open and joined in that
+// order. 2-opt then runs on a window around every seam. Needs city coordinates only
+long clusterDecompositionTour(int *tour, int thread_count, int cluster_cities)
+{
+    double begin = omp_get_wtime();
+    int k = (N + cluster_cities - 1) / cluster_cities;
+    k = k < 1 ? 1 : k;
+    int *medoids = malloc(k * sizeof(int));
+    int *cluster = malloc(N * sizeof(int));
+    int *first = malloc((k + 1) * sizeof(int));
+    int *members = malloc(N * sizeof(int));
+    double *cx = malloc(k * sizeof(double));
+    double *cy = malloc(k * sizeof(double));
+    int *live = malloc(k * sizeof(int));
+    int *order = malloc(k * sizeof(int));
+    int *start = malloc(k * sizeof(int));
+    int *path = malloc(N * sizeof(int));
+
+    // Seed the medoids evenly along the Hilbert curve, so they start spread over the cities
+    hilbertTour(tour, thread_count);
+    for (int c = 0; c < k; c++)
+    {
+        medoids[c] = tour[(long)c * N / k];
+    }
+    for (int i = 0; i < N; i++)
+    {
+        cluster[i] = -1;
+    }
+
+    // Alternate assigning cities to their nearest medoid and moving every medoid to the
+    // centre of its cluster, until no city changes cluster
+    tracePhaseBegin("kMedoids");
+    int rounds = 0;
+    while (rounds < CLUSTER_ROUNDS)
+    {
+        rounds++;
+        if (assignClusters(medoids, k, cluster, thread_count) == 0)
+            break;
+        clusterMembers(cluster, k, first, members);
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic)
+        for (int c = 0; c < k; c++)
+        {
+            if (first[c + 1] > first[c])
+                medoids[c] = clusterMedoid(&members[first[c]], first[c + 1] - first[c], &cx[c], &cy[c]);
+        }
+    }
+    clusterMembers(cluster, k, first, members);
+    traceEnd();
+
+    // Cities at the same point as a medoid can leave a cluster empty; order the others by
+    // their means
+    int live_count = 0;
+    for (int c = 0; c < k; c++)
+    {
+        int m = first[c + 1] - first[c];
+        if (m == 0)
+            continue;
+        double x = 0, y = 0;
+        for (int a = first[c]; a < first[c + 1]; a++)
+        {
+            x += cities[members[a]].x;
+            y += cities[members[a]].y;
+        }
+        cx[live_count] = x / m;
+        cy[live_count] = y / m;
+        live[live_count++] = c;
+    }
+    orderClusters(cx, cy, live_count, order);
+
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 1)
+    for (int s = 0; s < live_count; s++)
+    {
+        int c = live[s];
+        traceBegin("solveCluster");
+        solveCluster(&members[first[c]], first[c + 1] - first[c]);
+        traceEnd();
+    }
+
+    // Join the cluster tours: enter each at the city nearest the previous exit (the first
+    // at the city nearest the last centre), and leave through whichever neighbour of the
+    // entry is nearer the next centre, or the first entry after the last cluster
+    int count = 0;
+    for (int s = 0; s < live_count; s++)
+    {
+        int c = live[order[s]];
+        int m = first[c + 1] - first[c];
+        const int *t = &members[first[c]];
+        double px = s == 0 ? cx[order[live_count - 1]] : cities[path[count - 1]].x;
+        double py = s == 0 ? cy[order[live_count - 1]] : cities[path[count - 1]].y;
+        int entry = 0;
+        double entry_d = DBL_MAX;
+        for (int a = 0; a < m; a++)
+        {
+            double dx = cities[t[a]].x - px, dy = cities[t[a]].y - py;
+            if (dx * dx + dy * dy < entry_d)
+            {
+                entry_d = dx * dx + dy * dy;
+                entry = a;
+            }
+        }
+
+        int next = s + 1 < live_count ? order[s + 1] : -1;
+        double nx = next >= 0 ? cx[next] : s > 0 ? cities[path[0]].x : cx[order[s]];
+        double ny = next >= 0 ? cy[next] : s > 0 ? cities[path[0]].y : cy[order[s]];
+        int back = t[(entry + m - 1) % m], ahead = t[(entry + 1) % m];
+        double back_d = hypot(cities[back].x - nx, cities[back].y - ny);
+        double ahead_d = hypot(cities[ahead].x - nx, cities[ahead].y - ny);
+        int step = back_d <= ahead_d ? 1 : m - 1;
+
+        start[s] = count;
+        for (int a = 0; a < m; a++)
+        {
+            path[count++] = t[(entry + (long)a * step) % m];
+        }
+    }
+
+    // Rotate the tour to start half way through the first cluster, so every seam has room
+    // on both sides, then run 2-opt around the seams in parallel. A window takes at most half
+    // of each cluster it touches, so the windows never overlap
+    int first_length = first[live[order[0]] + 1] - first[live[order[0]]];
+    int shift = first_length / 2;
+    for (int i = 0; i < N; i++)
+    {
+        tour[i] = path[(i + shift) % N];
+    }
+    long seam_moves = 0;
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 1) reduction(+ : seam_moves)
+    for (int s = 0; s < (live_count > 1 ? live_count : 0); s++)
+    {
+        int before = live[order[(s + live_count - 1) % live_count]];
+        int after = live[order[s]];
+        int seam = s == 0 ? N - shift : start[s] - shift;
+        int half_before = (first[before + 1] - first[before]) / 2;
+        int half_after = (first[after + 1] - first[after]) / 2;
+        int lo = seam - (half_before < CLUSTER_SEAM ? half_before : CLUSTER_SEAM);
+        int hi = seam + (half_after < CLUSTER_SEAM ? half_after : CLUSTER_SEAM);
+        traceBegin("seamTwoOpt");
+        seam_moves += seamTwoOpt(tour, lo, hi);
+        traceEnd();
+    }
+    tour[N] = tour[0];
+
+    printf("Cluster decomposition: %d clusters after %d k-medoids rounds, %ld seam moves, %fs\n",
+           live_count, rounds, seam_moves, omp_get_wtime() - begin);
+
+    free(medoids);
+    free(cluster);
+    free(first);
+    free(members);
+    free(cx);
+    free(cy);
+    free(live);
+    free(order);
+    free(start);
+    free(path);
+
+    return tourCost(tour);
+}
+
+// Function to recompute tau^alpha * eta^beta for every edge
+void updateChoiceInfo(int thread_count)
+{
+#pragma omp parallel for num_threads(thread_count)
+    for (long i = 0; i < (long)N * N; i++)
+    {
+        double tau = ACO_ALPHA == 1.0 ? pheromone[i] : pow(pheromone[i], ACO_ALPHA);
+        choice_info[i] = tau * heuristic[i];
+    }
+}
+
+// Function to allocate the colony and set the initial pheromone levels
+void initColony(int thread_count)
+{
+    pheromone = malloc((size_t)N * N * sizeof(double));
+    heuristic = malloc((size_t)N * N * sizeof(double));
+    choice_info = malloc((size_t)N * N * sizeof(double));
+    aco_mask = malloc((size_t)thread_count * N * sizeof(double));
+    aco_prob = malloc((size_t)thread_count * N * sizeof(double));
+    ant_tours = malloc((size_t)ACO_ANTS * (N + 1) * sizeof(int));
+    ant_costs = malloc(ACO_ANTS * sizeof(long));
+
+    // Start every edge at 1 / (N * L) where L is the sum of the nearest-neighbour distances
+    double total = 0;
+    for (int i = 0; i < N; i++)
+    {
+        total += nearest_distance[i] > 0 ? nearest_distance[i] : 1;
+    }
+    double tau0 = 1.0 / (N * total);
+
+#pragma omp parallel num_threads(thread_count)
+    {
+        int *row = malloc(N * sizeof(int));
+
+#pragma omp for
+        for (int i = 0; i < N; i++)
+        {
+            distanceRow(&dist_table, i, 0, N, row);
+            for (int j = 0; j < N; j++)
+            {
+                double d = row[j] > 0 ? row[j] : 1;
+                pheromone[(size_t)i * N + j] = tau0;
+                heuristic[(size_t)i * N + j] = i == j ? 0 : pow(1.0 / d, ACO_BETA);
+            }
+        }
+
+        free(row);
+    }
+
+    updateChoiceInfo(thread_count);
+}
+
+// Function to build one ant's tour by repeated roulette selection over the unvisited cities
+long constructAntTour(int *tour, double *mask, double *prob, RandomStream *stream)
+{
+    long cost = 0;
+
+    for (int i = 0; i < N; i++)
+    {
+        mask[i] = 1.0;
+    }
+
+    int currCity = (int)(streamRandom(stream) * N);
+    tour[0] = currCity;
+    mask[currCity] = 0.0;
+
+    for (int step = 1; step < N; step++)
+    {
+        const double *row = &choice_info[(size_t)currCity * N];
+        double total = 0;
+
+        // Candidate-probability kernel: weight of every city, zeroed for visited ones
+#pragma omp simd reduction(+ : total)
+        for (int j = 0; j < N; j++)
+        {
+            prob[j] = row[j] * mask[j];
+            total += prob[j];
+        }
+
+        int nextCity = -1;
+        if (total > 0)
+        {
+            // Roulette wheel selection
+            double r = streamRandom(stream) * total;
+            double sum = 0;
+            for (int j = 0; j < N; j++)
+            {
+                sum += prob[j];
+                if (sum >= r && prob[j] > 0)
+                {
+                    nextCity = j;
+                    break;
+                }
+            }
+        }
+        if (nextCity < 0)
+        {
+            // Weights underflowed or rounding missed the target, take the first unvisited city
+            for (int j = 0; j < N; j++)
+            {
+                if (mask[j] != 0.0)
+                {
+                    nextCity = j;
+                    break;
+                }
+            }
+        }
+
+        cost += distance(currCity, nextCity);
+        tour[step] = nextCity;
+        mask[nextCity] = 0.0;
+        currCity = nextCity;
+    }
+
+    // Return to the starting city
+    cost += distance(currCity, tour[0]);
+    tour[N] = tour[0];
+
+    return cost;
+}
+
+// Function to run one colony iteration: build all tours, evaporate, then deposit pheromone
+long acoIteration(int thread_count, int iteration)
+{
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic)
+    for (int ant = 0; ant < ACO_ANTS; ant++)
+    {
+        int tid = omp_get_thread_num();
+        RandomStream stream;
+        traceBegin("constructAntTour");
+        initStream(&stream, (long)iteration * ACO_ANTS + ant);
+        ant_costs[ant] = constructAntTour(&ant_tours[(size_t)ant * (N + 1)], &aco_mask[(size_t)tid * N], &aco_prob[(size_t)tid * N], &stream);
+        traceEnd();
+    }
+
+    // Evaporation over the whole contiguous matrix
+#pragma omp parallel for simd num_threads(thread_count)
+    for (long i = 0; i < (long)N * N; i++)
+    {
+        pheromone[i] *= 1.0 - ACO_RHO;
+    }
+
+    // Every ant deposits 1 / L on the edges of its tour
+    int best = 0;
+    for (int ant = 0; ant < ACO_ANTS; ant++)
+    {
+        const int *tour = &ant_tours[(size_t)ant * (N + 1)];
+        double deposit = 1.0 / ant_costs[ant];
+        for (int i = 0; i < N; i++)
+        {
+            pheromone[(size_t)tour[i] * N + tour[i + 1]] += deposit;
+            pheromone[(size_t)tour[i + 1] * N + tour[i]] += deposit;
+        }
+        if (ant_costs[ant] < ant_costs[best])
+        {
+            best = ant;
+        }
+    }
+
+    // Reinforce the best tour found so far as well
+    if (global_count == N + 1)
+    {
+        double deposit = 1.0 / global_mincost;
+        for (int i = 0; i < N; i++)
+        {
+            pheromone[(size_t)global_visited_cities[i] * N + global_visited_cities[i + 1]] += deposit;
+            pheromone[(size_t)global_visited_cities[i + 1] * N + global_visited_cities[i]] += deposit;
+        }
+    }
+
+    updateChoiceInfo(thread_count);
+
+    updateBestTour(&ant_tours[(size_t)best * (N + 1)], ant_costs[best], (long)iteration * ACO_ANTS + best);
+    global_tours += ACO_ANTS;
+
+    return global_mincost;
+}
+
+// Function to set every distance of a city from its coordinates, rounded as -g does
+void cityDistances(int city, int thread_count)
+{
+    for (int j = 0; j < N; j++)
+    {
+        int d = (int)(calculateDistance(cities[city], cities[j]) + 0.5);
+        distanceStore(&dist_table, city, j, d, thread_count);
+        if (!distanceSymmetric(&dist_table))
+            distanceStore(&dist_table, j, city, d, thread_count);
+    }
+}
+
+// Function to insert a city where it adds the least to the tour, returns its position. The
+// arrays must have room for one more city, see tourEvalReserve
+int tourEvalInsert(TourEval *eval, int city)
+{
+    int n = eval->n;
+    int best = 0;
+    long best_cost = LONG_MAX;
+    int *to = malloc(N * sizeof(int));
+    int *from = malloc(N * sizeof(int));
+    distanceColumn(&dist_table, city, 0, N, to);
+    distanceRow(&dist_table, city, 0, N, from);
+    for (int k = 0; k < n; k++)
+    {
+        long cost = (long)to[eval->tour[k]] + from[eval->tour[k + 1]] - tourEvalSegment(eval, k, k + 1, 0);
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best = k;
+        }
+    }
+    free(to);
+    free(from);
+
+    memmove(&eval->tour[best + 2], &eval->tour[best + 1], (n - best) * sizeof(int));
+    eval->tour[best + 1] = city;
+    eval->n = n + 1;
+    tourEvalRefresh(eval, best + 1);
+    return best + 1;
+}
+
+// Function to take a city out of the tour
+void tourEvalRemove(TourEval *eval, int city)
+{
+    int p = eval->position[city];
+    memmove(&eval->tour[p], &eval->tour[p + 1], (eval->n - p) * sizeof(int));
+    eval->n--;
+    eval->tour[eval->n] = eval->tour[0];
+    tourEvalRefresh(eval, p);
+}
+
+// Function to re-optimise the tour around the changed cities: best-improvement 2-opt where one
+// end of the reversed stretch lies within REPAIR_WINDOW positions of a changed city (of any
+// city when whole_tour is set), the other anywhere. Candidate moves are scanned in parallel
+// with O(1) deltas from the rows and columns around each region position; returns the moves made
+int repairTour(TourEval *eval, const int *changed, int changed_count, int whole_tour, long *gain, int thread_count)
+{
+    int moves = 0;
+    size_t mark = arenaMark(&workspace);
+    char *in_region = arenaAlloc(&workspace, eval->n + 1);
+    int *region = arenaAlloc(&workspace, (eval->n + 1) * sizeof(int));
+    int *lines = arenaAlloc(&workspace, 4 * (size_t)N * thread_count * sizeof(int));
+    *gain = 0;
+
+    while (moves < REPAIR_MAX_MOVES && eval->n > 3)
+    {
+        int n = eval->n;
+        int count = 0;
+        memset(in_region, 0, n + 1);
+        for (int k = 1; whole_tour && k < n; k++)
+        {
+            in_region[k] = 1;
+            region[count++] = k;
+        }
+        for (int c = 0; !whole_tour && c < changed_count; c++)
+        {
+            int p = eval->position[changed[c]];
+            for (int k = p - REPAIR_WINDOW; k <= p + REPAIR_WINDOW; k++)
+            {
+                if (k >= 1 && k < n && !in_region[k])
+                {
+                    in_region[k] = 1;
+                    region[count++] = k;
+                }
+            }
+        }
+
+        long best_delta = 0;
+        int best_i = 0, best_j = 0;
+#pragma omp parallel num_threads(thread_count)
+        {
+            long local_delta = 0;
+            int local_i = 0, local_j = 0;
+            const int *t = eval->tour;
+            int *from_prev = &lines[4 * (size_t)N * omp_get_thread_num()];
+            int *from_city = from_prev + N, *to_city = from_prev + 2 * N, *to_next = from_prev + 3 * N;
+#pragma omp for schedule(dynamic, 4)
+            for (int r = 0; r < count; r++)
+            {
+                // A move starting at p joins tour[p - 1] and tour[p] to the far end, one ending
+                // at p joins the far end to tour[p] and tour[p + 1]
+                int p = region[r];
+                distanceRow(&dist_table, t[p - 1], 0, N, from_prev);
+                distanceRow(&dist_table, t[p], 0, N, from_city);
+                distanceColumn(&dist_table, t[p], 0, N, to_city);
+                distanceColumn(&dist_table, t[p + 1], 0, N, to_next);
+                for (int other = 1; other < n; other++)
+                {
+                    int i = p < other ? p : other;
+                    int j = p < other ? other : p;
+                    if (i == j || (in_region[other] && other < p))
+                        continue;
+                    long delta = p == i ? tourEvalTwoOptDelta(eval, i, j, from_prev[t[j]], from_city[t[j + 1]])
+                                        : tourEvalTwoOptDelta(eval, i, j, to_city[t[i - 1]], to_next[t[i]]);
+                    if (delta < local_delta || (delta == local_delta && delta < 0 && (i < local_i || (i == local_i && j < local_j))))
+                    {
+                        local_delta = delta;
+                        local_i = i;
+                        local_j = j;
+                    }
+                }
+            }
+#pragma omp critical
+            if (local_delta < best_delta || (local_delta == best_delta && local_delta < 0 && (local_i < best_i || (local_i == best_i && local_j < best_j))))
+            {
+                best_delta = local_delta;
+                best_i = local_i;
+                best_j = local_j;
+            }
+        }
+
+        if (best_delta >= 0)
+            break;
+        tourEvalApplyTwoOpt(eval, best_i, best_j);
+        *gain -= best_delta;
+        moves++;
+    }
+
+    arenaRelease(&workspace, mark);
+    return moves;
+}
+
+// Function to add a city to a batch's repair list. When the list is full the batch repairs
+// the whole tour instead, and no more cities are listed
+static void markChanged(int *changed, int *changed_count, int capacity, int *whole_tour, int city)
+{
+    if (*whole_tour)
+        return;
+    if (*changed_count >= capacity)
+    {
+        *whole_tour = 1;
+        return;
+    }
+    changed[(*changed_count)++] = city;
+}
+
+// Function to serve updates to the instance and the best tour on a Unix socket until a
+// client sends shutdown. Clients are served one at a time; each batch is applied, the tour
+// repaired around the cities it touched, and the answer carries the request latency
+int serveUpdates(const char *socket_path, const char *cities_file, int thread_count)
+{
+    int has_coordinates = loadCities(cities_file) >= N;
+    // The solve is over, its tour scratch is no longer needed
+    arenaReset(&workspace);
+    int *active = malloc(N * sizeof(int));
+    for (int i = 0; i < N; i++)
+    {
+        active[i] = 1;
+    }
+
+    TourEval eval;
+    tourEvalInit(&eval, global_visited_cities, N);
+    // Arrays indexed by city have room for capacity cities and grow geometrically, as the
+    // distance table does, so an add costs O(N) amortised
+    int capacity = N;
+
+    // A client that hangs up early must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server, 4) != 0)
+    {
+        printf("Error listening on %s.\n", socket_path);
+        return 0;
+    }
+    printf("Serving %d cities on %s (tour cost %ld)\n", eval.n, socket_path, tourEvalCost(&eval));
+    fflush(stdout);
+
+    long requests = 0;
+    int running = 1;
+    while (running)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+            continue;
+        FILE *in = fdopen(client, "r");
+        char line[256];
+        int *changed = malloc(capacity * sizeof(int));
+        int changed_count = 0, whole_tour = 0, updates = 0, errors = 0, send_tour = 0;
+        double start = 0;
+
+        while (running && fgets(line, sizeof(line), in) != NULL)
+        {
+            char command[16];
+            int a, b, c;
+            if (updates == 0 && errors == 0 && !send_tour)
+                start = omp_get_wtime();
+            if (sscanf(line, "%15s", command) != 1)
+                continue;
+
+            if (strcmp(command, "end") == 0)
+            {
+                long cost_before = tourEvalCost(&eval), gain;
+                // Grow the workspace with the instance; nothing else is held in it here
+                if (arenaReserve(&workspace, (size_t)(capacity + 1) * (sizeof(int) + 1) + 4 * (size_t)capacity * thread_count * sizeof(int) + 3 * ARENA_ALIGN) != 0)
+                {
+                    printf("Error mapping the workspace.\n");
+                    exit(1);
+                }
+                traceBegin("repairTour");
+                int moves = repairTour(&eval, changed, changed_count, whole_tour, &gain, thread_count);
+                traceEnd();
+                double latency = omp_get_wtime() - start;
+                requests++;
+                dprintf(client, "ok cost %ld cities %d updates %d errors %d moves %d gain %ld latency_ms %.3f\n",
+                        tourEvalCost(&eval), eval.n, updates, errors, moves, gain, latency * 1e3);
+                if (send_tour)
+                {
+                    for (int k = 0; k <= eval.n; k++)
+                        dprintf(client, k < eval.n ? "%d->" : "%d\n", eval.tour[k]);
+                }
+                printf("Request %ld: %d updates, cost %ld -> %ld after %d moves, %.3f ms\n",
+                       requests, updates, cost_before, tourEvalCost(&eval), moves, latency * 1e3);
+                fflush(stdout);
+                changed_count = whole_tour = updates = errors = send_tour = 0;
+            }
+            else if (strcmp(command, "shutdown") == 0)
+            {
+                dprintf(client, "shutting down\n");
+                running = 0;
+            }
+            else if (strcmp(command, "tour") == 0)
+            {
+                send_tour = 1;
+            }
+            else if (strcmp(command, "add") == 0 && has_coordinates && sscanf(line, "%*s %d %d", &a, &b) == 2)
+            {
+                int city = N;
+                if (N == capacity)
+                {
+                    capacity = (int)(capacity * DISTANCE_GROWTH) + 1;
+                    cities = realloc(cities, capacity * sizeof(City));
+                    active = realloc(active, capacity * sizeof(int));
+                    changed = realloc(changed, capacity * sizeof(int));
+                    tourEvalReserve(&eval, capacity);
+                }
+                distanceTableResize(&dist_table, N + 1, distanceWide(&dist_table), thread_count);
+                N++;
+                cities[city].x = a;
+                cities[city].y = b;
+                active[city] = 1;
+                cityDistances(city, thread_count);
+                tourEvalInsert(&eval, city);
+                markChanged(changed, &changed_count, N, &whole_tour, city);
+                updates++;
+                dprintf(client, "added %d\n", city);
+            }
+            else if (strcmp(command, "remove") == 0 && sscanf(line, "%*s %d", &a) == 1 && a >= 0 && a < N && active[a] && eval.n > 3)
+            {
+                int p = eval.position[a];
+                tourEvalRemove(&eval, a);
+                active[a] = 0;
+                // The cities that now meet across the gap are the ones to repair around
+                markChanged(changed, &changed_count, N, &whole_tour, eval.tour[p == 0 ? eval.n - 1 : p - 1]);
+                markChanged(changed, &changed_count, N, &whole_tour, eval.tour[p < eval.n ? p : 0]);
+                updates++;
+            }
+            else if (strcmp(command, "move") == 0 && has_coordinates && sscanf(line, "%*s %d %d %d", &a, &b, &c) == 3 && a >= 0 && a < N && active[a] && eval.n > 3)
+            {
+                tourEvalRemove(&eval, a);
+                cities[a].x = b;
+                cities[a].y = c;
+                cityDistances(a, thread_count);
+                tourEvalInsert(&eval, a);
+                markChanged(changed, &changed_count, N, &whole_tour, a);
+                updates++;
+            }
+            else if (strcmp(command, "edge") == 0 && sscanf(line, "%*s %d %d %d", &a, &b, &c) == 3 && a >= 0 && a < N && b >= 0 && b < N && a != b && c >= 0 && active[a] && active[b])
+            {
+                distanceStore(&dist_table, a, b, c, thread_count);
+                int pa = eval.position[a], pb = eval.position[b];
+                tourEvalRefresh(&eval, pa < pb ? pa : pb);
+                markChanged(changed, &changed_count, N, &whole_tour, a);
+                markChanged(changed, &changed_count, N, &whole_tour, b);
+                updates++;
+            }
+            else
+            {
+                line[strcspn(line, "\r\n")] = '\0';
+                dprintf(client, "error %s\n", line);
+                errors++;
+            }
+        }
+        free(changed);
+        fclose(in);
+    }
+
+    close(server);
+    unlink(socket_path);
+    tourEvalFree(&eval);
+    free(active);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_count = strtol(argv[1], NULL, 10);
+    SolverMode mode = MODE_NN;
+    const char *cities_file = CITIES_FILE;
+    const char *distances_file = DISTANCES_FILE;
+    int time_limit = TIME_LIMIT;
+    int deterministic = 0;
+    long rounds = DETERMINISTIC_ROUNDS;
+    const char *generate_output = NULL;
+    const char *socket_path = NULL;
+    const char *trace_file = NULL;
+    double gap_limit = HK_GAP;
+    int cluster_cities = CLUSTER_CITIES;
+    int i = 0;
+
+    for (i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "nn") == 0)
+            {
+                mode = MODE_NN;
+            }
+            else if (strcmp(argv[i], "aco") == 0)
+            {
+                mode = MODE_ACO;
+            }
+            else if (strcmp(argv[i], "greedy") == 0)
+            {
+                mode = MODE_GREEDY;
+            }
+            else if (strcmp(argv[i], "mst") == 0)
+            {
+                mode = MODE_MST;
+            }
+            else if (strcmp(argv[i], "hilbert") == 0)
+            {
+                mode = MODE_HILBERT;
+            }
+            else if (strcmp(argv[i], "cluster") == 0)
+            {
+                mode = MODE_CLUSTER;
+            }
+            else
+            {
+                printf("Unknown solver mode %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            distances_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            cities_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+        {
+            socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-g") == 0 && i + 2 < argc)
+        {
+            cities_file = argv[++i];
+            generate_output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            time_limit = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            random_seed = strtoull(argv[++i], NULL, 10);
+            deterministic = 1;
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            rounds = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            gap_limit = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            cluster_cities = strtol(argv[++i], NULL, 10);
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (cluster_cities < 1)
+    {
+        printf("Need at least one city per cluster.\n");
+        return 1;
+    }
+    if (mode == MODE_CLUSTER && socket_path != NULL)
+    {
+        printf("The cluster mode has no distance table to serve updates from.\n");
+        return 1;
+    }
+
+    if (!deterministic)
+    {
+        random_seed = (unsigned long long)time(NULL);
+    }
+
+    if (generate_output != NULL)
+    {
+        double generate_start = omp_get_wtime();
+        if (generateDistances(cities_file, generate_output, thread_count) == 0)
+        {
+            printf("Error generating distances from %s.\n", cities_file);
+            return 1;
+        }
+        printf("Wrote %d cities (%zu %s entries) to %s in %fs\n", N, (size_t)N * (N - 1) / 2,
+               distanceWide(&dist_table) ? "uint32" : "uint16", generate_output, omp_get_wtime() - generate_start);
+        return 0;
+    }
+
+    if (trace_file != NULL)
+    {
+        traceInit(thread_count);
+    }
+
+    clock_t start = clock(); // Start the time to time reading the file and the computation
+
+    // Read file
+    // If there is an error in opeing the file, print an error
+    tracePhaseBegin("loadDistances");
+    if ((mode == MODE_CLUSTER ? loadGeometricDistances(cities_file) : loadDistances(distances_file)) == 0)
+    {
+        printf("Error opening file.\n");
+        return 1;
+    }
+    traceEnd();
+
+    // Quadratic in N, and the cluster mode does not use it
+    if (mode != MODE_CLUSTER)
+    {
+        tracePhaseBegin("precomputeNearestNeighbors");
+        precomputeNearestNeighbors(thread_count);
+        traceEnd();
+
+        tracePhaseBegin("findOptimalStartingCity");
+        findOptimalStartingCity();
+        traceEnd();
+    }
+
+    if (arenaReserve(&workspace, workspaceBytes(thread_count)) != 0)
+    {
+        printf("Error mapping the workspace.\n");
+        return 1;
+    }
+    tour_scratch = arenaAlloc(&workspace, thread_count * sizeof(TourScratch));
+    for (int t = 0; t < thread_count; t++)
+    {
+        tour_scratch[t].tour = arenaAlloc(&workspace, (N + 1) * sizeof(int));
+        tour_scratch[t].visited = arenaCalloc(&workspace, N * sizeof(int));
+        tour_scratch[t].row = arenaAlloc(&workspace, N * sizeof(int));
+        tour_scratch[t].stamp = 0;
+    }
+    HeldKarpBound bound;
+    heldKarpInit(&bound, &dist_table, &workspace);
+
+    // printf("\n\nThe cost list is:");
+
+    // for (i = 0; i < N; i++)
+    // {
+    //     printf("\n");
+
+    //     for (j = 0; j < N; j++)
+    //         printf("%d ", distance(i, j));
+    // }
+    // printf("\n");
+
+    if (mode == MODE_ACO)
+    {
+        tracePhaseBegin("initColony");
+        initColony(thread_count);
+        traceEnd();
+    }
+    else if (mode == MODE_HILBERT && loadCities(cities_file) < N)
+    {
+        printf("Error reading %d city coordinates from %s.\n", N, cities_file);
+        return 1;
+    }
+
+    // The other constructors are deterministic, so a single tour is enough
+    if (mode == MODE_GREEDY || mode == MODE_MST || mode == MODE_HILBERT || mode == MODE_CLUSTER)
+    {
+        int *tour = malloc((N + 1) * sizeof(int));
+        long cost;
+        tracePhaseBegin(mode == MODE_GREEDY ? "greedyEdgeTour" : mode == MODE_MST ? "mstTour" : mode == MODE_HILBERT ? "hilbertTour" : "clusterDecompositionTour");
+        if (mode == MODE_GREEDY)
+            cost = greedyEdgeTour(tour, thread_count);
+        else if (mode == MODE_MST)
+            cost = mstTour(tour, thread_count);
+        else if (mode == MODE_HILBERT)
+            cost = hilbertTour(tour, thread_count);
+        else
+            cost = clusterDecompositionTour(tour, thread_count, cluster_cities);
+        traceEnd();
+        updateBestTour(tour, cost, 0);
+        global_tours++;
+        free(tour);
+
+        // Nothing more to construct, so tighten the bound only as far as the gap needs. Every
+        // step is quadratic in N, too slow for the instances the cluster mode is for
+        while (mode != MODE_CLUSTER && !bound.done && heldKarpGap(&bound, global_mincost) > gap_limit)
+        {
+            traceBegin("heldKarpStep");
+            heldKarpStep(&bound, global_mincost, thread_count);
+            traceEnd();
+        }
+    }
+
+    // Each round builds a fixed block of tours: thread t of T always gets tour round * T + t
+    long round = 0;
+    while ((mode == MODE_NN || mode == MODE_ACO) && (deterministic ? round < rounds : (clock() - start) / CLOCKS_PER_SEC < time_limit))
+    {
+        if (mode == MODE_ACO)
+        {
+            traceBegin("acoIteration");
+            acoIteration(thread_count, round++);
+            traceEnd();
+        }
+        else
+        {
+#pragma omp parallel num_threads(thread_count)
+            {
+                long tour_index = round * thread_count + omp_get_thread_num();
+
+                findMinCost(&tour_scratch[omp_get_thread_num()], tourStartCity(tour_index), tour_index);
+            }
+            round++;
+        }
+
+        // One subgradient step per round, with the best tour so far as the upper bound. Tours
+        // built after the best one cannot replace it once the gap is closed, so a deterministic
+        // run that stops here reports the same tour
+        if (!bound.done)
+        {
+            traceBegin("heldKarpStep");
+            heldKarpStep(&bound, global_mincost, thread_count);
+            traceEnd();
+        }
+        if (heldKarpGap(&bound, global_mincost) <= gap_limit)
+        {
+            break;
+        }
+    }
+
+    // Check the reported tour before printing it
+    tracePhaseBegin("validateTour");
+    int valid = global_count == N + 1 && validateTour(global_visited_cities) && tourCost(global_visited_cities) == global_mincost;
+    traceEnd();
+    if (!valid)
+    {
+        printf("Error: the best tour is not a valid tour of cost %ld.\n", global_mincost);
+        return 1;
+    }
+
+    printf("Minimum cost: %ld\n", global_mincost);
+
+    printf("The number of cities traversed: %d\n", global_count);
+
+    printf("Tours constructed: %ld\n", global_tours);
+
+    if (bound.iterations > 0)
+    {
+        printf("Held-Karp bound: %ld after %d iterations, gap %.2f%%\n", heldKarpValue(&bound), bound.iterations, heldKarpGap(&bound, global_mincost));
+    }
+
+    if (deterministic)
+    {
+        printf("Seed: %llu, best tour index: %ld\n", random_seed, global_best_index);
+    }
+
+    printf("The list of cities reversed in order: ");
+    for (i = 0; i < global_count; i++)
+    {
+        if (i == global_count - 1)
+        {
+            printf("%d", global_visited_cities[i]);
+        }
+        else {
+            printf("%d->", global_visited_cities[i]);
+        }
+    }
+
+    printf("\n");
+
+    if (socket_path != NULL && serveUpdates(socket_path, cities_file, thread_count) == 0)
+    {
+        return 1;
+    }
+
+    if (trace_file != NULL)
+    {
+        long events = traceWrite(trace_file);
+        if (events < 0)
+        {
+            printf("Error writing %s.\n", trace_file);
+            return 1;
+        }
+        printf("Wrote %ld trace events to %s\n", events, trace_file);
+        traceFree();
+    }
 
     return 0;
 }
\ No newline at end of file
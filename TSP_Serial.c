@@ -2,8 +2,11 @@
  * @file tsp.c
  * @authors Camp Steiner, Jeff Luong
  *
- * Compile:  gcc -Wall -g -fopenmp -o tsp.o tsp.c -std=c99 -lm
- * Usage: ./tsp.o <number of threads>
+ * Compile:  gcc -Wall -g -fopenmp -o tsp.o tsp.c arena.c trace.c distance.c -std=c99 -lm
+ * Usage: ./tsp.o <number of threads> [-f distance matrix csv or packed file] [-t seconds]
+ *                                     [-T trace json]
+ *        -T writes the loading and tour construction phases and the total minDistance scan time
+ *        as a Chrome trace
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,16 +16,39 @@
 #include <time.h>
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
+#include "arena.h"
+#include "trace.h"
+#include "distance.h"
 
-// Number of cities
-#define N 1000
+// Number of cities, set from the number of columns in the distance matrix
+int N = 0;
+
+// Default input file and time budget in seconds
+#define DISTANCES_FILE "DistanceMatrix1000_v2.csv"
+#define TIME_LIMIT 60
 
-// Matrix to store the distances between the cities
-int distances[N][N] = {{0}};
 // int global_visited_cities[N + 1] = {0};
 int *global_visited_cities;
-int global_mincost = 99999999;
+// Cost of the best tour, LONG_MAX until the first one is recorded
+long global_mincost = LONG_MAX;
 int global_count = 0;
+// Number of tours built, used to report construction throughput
+long global_tours = 0;
+
+// Scratch of the solver, sized once per problem: the tour buffers for the whole solve, then
+// short-lived buffers taken with a mark and released before returning
+Arena workspace;
+
+// Tour buffers. visited[c] == stamp marks city c as visited by the current tour, so starting
+// a tour only bumps the stamp
+typedef struct
+{
+    int *tour;
+    int *visited;
+    int *row; // distances from the current city
+    int stamp;
+} TourScratch;
 
     // Define a structure to represent a city
     typedef struct
@@ -32,61 +58,99 @@ int global_count = 0;
 } City;
 
 // Declare an array of City structures to represent the cities
-City cities[N];
+City *cities;
+
+// Nearest neighbour of every city and the distance to it
+int *nearest_city;
+int *nearest_distance;
+int optimal_city = 0;
+
+// Distances of the instance, in the smallest form that holds them (see distance.h). Hot loops
+// fetch rows of it; distance(i, j) is for the occasional single lookup
+DistanceTable dist_table;
+
+static inline int distance(int i, int j)
+{
+    return distanceAt(&dist_table, i, j);
+}
+
+// Function to read the distance matrix and allocate the per-city arrays. A CSV matrix has
+// as many cities as columns in its first row; a packed file written by -g is detected by
+// its header
+int loadDistances(const char *filename)
+{
+    N = distanceTableLoad(&dist_table, filename);
+    if (N == 0)
+    {
+        return 0;
+    }
+
+    cities = calloc(N, sizeof(City));
+    nearest_city = malloc(N * sizeof(int));
+    nearest_distance = malloc(N * sizeof(int));
+    global_visited_cities = malloc((N + 1) * sizeof(int));
+
+    return N;
+}
 
 // Function to calculate the distance between two cities
 double calculateDistance(City city1, City city2)
 {
-    double distance = sqrt(pow(city1.x - city2.x, 2) + pow(city1.y - city2.y, 2));
-    return distance;
+    double dx = city1.x - city2.x;
+    double dy = city1.y - city2.y;
+    return sqrt(dx * dx + dy * dy);
 }
 
-// Function to find the minimum distance from each city to the next closest city
-int findOptimalStartingCity()
+// Function to find each city's nearest neighbour and the closest pair's starting city,
+// done once after the distance matrix is loaded
+void precomputeNearestNeighbors()
 {
-    // Initialize the minimum distance and index of the optimal starting city
-    double minDistance = DBL_MAX;
-    int minIndex = 0;
-    // Loop through all cities
+    int *row = malloc(N * sizeof(int));
     for (int i = 0; i < N; i++)
     {
-        // Initialize the minimum distance to the next closest city
-        double minNextDistance = DBL_MAX;
+        int minNextDistance = INT_MAX;
+        int minNextIndex = i;
 
-        // Loop through all other cities
+        distanceRow(&dist_table, i, 0, N, row);
         for (int j = 0; j < N; j++)
         {
             // Skip the current city
             if (i == j)
                 continue;
 
-            // Calculate the distance between the two cities
-            double distance = calculateDistance(cities[i], cities[j]);
-
-            // Update the minimum distance to the next closest city
-            if (distance < minNextDistance)
+            if (row[j] < minNextDistance)
             {
-                minNextDistance = distance;
+                minNextDistance = row[j];
+                minNextIndex = j;
             }
         }
 
-        // Update the minimum distance and index of the optimal starting city
-        if (minNextDistance < minDistance)
+        nearest_distance[i] = minNextDistance;
+        nearest_city[i] = minNextIndex;
+    }
+    free(row);
+}
+
+// Function to find the optimal starting city, the one with the closest next city, once the
+// nearest neighbours are known. The tours read it from optimal_city
+int findOptimalStartingCity()
+{
+    optimal_city = 0;
+    for (int i = 1; i < N; i++)
+    {
+        if (nearest_distance[i] < nearest_distance[optimal_city])
         {
-            minDistance = minNextDistance;
-            minIndex = i;
+            optimal_city = i;
         }
     }
-
-    // Return the index of the optimal starting city
-    return minIndex;
+    return optimal_city;
 }
 
 
 
-// Function to find the minimum distance between the current city
-// and the remaining cities
-int minDistance(int currCity, int visited[N], int optimalCity)
+// Function to find the minimum distance between the current city, whose distances are in
+// row, and the remaining cities
+int minDistance(const int *row, const int *visited, int stamp, int optimalCity)
 {
     // Store the minimum distance and the index of the next city
     int min = INT_MAX;
@@ -96,13 +160,13 @@ int minDistance(int currCity, int visited[N], int optimalCity)
     for (int i = 0; i < N; i++)
     {
         // Check if the city has not been visited and is not the starting city
-        if (visited[i] == 0 && i != optimalCity)
+        if (visited[i] != stamp && i != optimalCity)
         {
             // Check if the distance is less than the minimum
-            if (distances[currCity][i] < min)
+            if (row[i] < min)
             {
                 // Update the minimum distance and the index of the next city
-                min = distances[currCity][i];
+                min = row[i];
                 minIndex = i;
             }
         }
@@ -112,108 +176,148 @@ int minDistance(int currCity, int visited[N], int optimalCity)
     return minIndex;
 }
 
-// Function to find the minimum cost of traveling to all cities
-int findMinCost(int visited[N])
+// Function to compute the cost of a closed tour of N + 1 cities
+long tourCost(const int *tour)
 {
-    int local_minCost = 0;
-    int optimalCity = findOptimalStartingCity();
-    int currCity = optimalCity;
-    int local_visited_cities[N];
-    int local_count = 1;
+    return distanceTourCost(&dist_table, tour, N);
+}
 
-    for (int i = 0; i < N; i++)
+// Function to check that a tour visits every city exactly once and returns to its start
+int validateTour(const int *tour)
+{
+    size_t mark = arenaMark(&workspace);
+    uint64_t *seen = arenaCalloc(&workspace, (N + 63) / 64 * sizeof(uint64_t));
+    int valid = tour[N] == tour[0];
+    for (int i = 0; i < N && valid; i++)
     {
-        visited[i] = 0;
+        int city = tour[i];
+        if (city < 0 || city >= N || (seen[city / 64] >> (city % 64) & 1))
+        {
+            valid = 0;
+        }
+        else
+        {
+            seen[city / 64] |= 1ULL << (city % 64);
+        }
     }
+    arenaRelease(&workspace, mark);
+    return valid;
+}
 
-    for (int i = 0; i < N; i++)
+// Function to find the minimum cost of traveling to all cities
+long findMinCost(TourScratch *scratch)
+{
+    traceBegin("findMinCost");
+    long local_minCost = 0;
+    int optimalCity = optimal_city;
+    int currCity = optimalCity;
+    int *local_visited_cities = scratch->tour;
+    int *visited = scratch->visited;
+    int local_count = 1;
+    double scan_time = 0;
+
+    // A new stamp unmarks every city; clear the marks only when the stamps run out
+    if (++scratch->stamp == INT_MAX)
     {
-        local_visited_cities[i] = 0;
+        memset(visited, 0, N * sizeof(int));
+        scratch->stamp = 1;
     }
+    int stamp = scratch->stamp;
 
     for (int i = 0; i < N; i++)
     {
         // printf("i = %d, city = %d\n", i, currCity);
-        visited[currCity] = 1;
+        visited[currCity] = stamp;
         local_visited_cities[i] = currCity;
         local_count++;
 
-        // Find the next closest city
-        int nextCity = minDistance(currCity, visited, optimalCity);
+        if (i < N - 1)
+        {
+            // Find the next closest city
+            double scan = traceNow();
+            distanceRow(&dist_table, currCity, 0, N, scratch->row);
+            int nextCity = minDistance(scratch->row, visited, stamp, optimalCity);
+            scan_time += traceNow() - scan;
 
-        // Add the distance to the minimum cost
-        local_minCost += distances[currCity][nextCity];
+            // Add the distance to the minimum cost
+            local_minCost += scratch->row[nextCity];
 
-        // Move to the next city
-        currCity = nextCity;
+            // Move to the next city
+            currCity = nextCity;
+        }
     }
 
-    // Add the distance from the last city to the starting city
-    local_minCost += distances[currCity][0];
-
-    // Set the visited flah for the starting city to 1
-    visited[0] = 1;
-
-    // Find the next closest cty (which should be the starting city)
-    int nextCity = minDistance(currCity, visited, optimalCity);
-
-    // Add the distance from the last city to the starting city
-    local_minCost += distances[currCity][nextCity];
+    // Add the distance from the last city back to the starting city
+    local_minCost += distance(currCity, optimalCity);
+    local_visited_cities[N] = optimalCity;
+    // Too many scans per tour for an event each, so the trace gets their total
+    traceAdd("minDistance", scan_time);
 
-    // Move to the starting city
-    currCity = nextCity;
-
-        if (local_minCost < global_mincost) {
-            global_mincost = local_minCost;
-            memcpy(global_visited_cities, local_visited_cities, sizeof(local_visited_cities));
-            global_count = local_count;
-        }
+    if (local_minCost < global_mincost)
+    {
+        global_mincost = local_minCost;
+        memcpy(global_visited_cities, local_visited_cities, (N + 1) * sizeof(int));
+        global_count = local_count;
+    }
+    global_tours++;
 
+    traceEnd();
     return global_mincost;
 }
 
 int main(int argc, char *argv[])
 {
     int thread_count = strtol(argv[1], NULL, 10);
-    char buffer[8192];
-    char *record, *line;
-    int i = 0, j = 0;
-    global_visited_cities = malloc(1001 * sizeof(int));
+    const char *distances_file = DISTANCES_FILE;
+    int time_limit = TIME_LIMIT;
+    const char *trace_file = NULL;
+    int i = 0;
+
+    for (i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            distances_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            time_limit = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (trace_file != NULL)
+    {
+        traceInit(1);
+    }
 
     clock_t start = clock(); // Start the time to time reading the file and the computation
 
-    FILE *file;
     // Read file
-    file = fopen("DistanceMatrix1000_v2.csv", "r");
-
     // If there is an error in opeing the file, print an error
-    if (file == NULL)
+    tracePhaseBegin("loadDistances");
+    if (loadDistances(distances_file) == 0)
     {
         printf("Error opening file.\n");
         return 1;
     }
+    traceEnd();
 
-    while ((line = fgets(buffer, sizeof(buffer), file)) != NULL)
-    {
-        j = 0;
-        record = strtok(line, ",");
-        while (record != NULL)
-        {
-            // Place record in array
-            distances[i][j] = atoi(record);
-            j++;
-            record = strtok(NULL, ",");
-        }
-        i++;
-        if (i == 1000)
-        {
-            // printf("%d \n", i);
-            // printf("%d \n", j);
-            break;
-        }
-    }
+    tracePhaseBegin("precomputeNearestNeighbors");
+    precomputeNearestNeighbors();
+    traceEnd();
 
-    fclose(file);
+    tracePhaseBegin("findOptimalStartingCity");
+    findOptimalStartingCity();
+    traceEnd();
 
     // printf("\n\nThe cost list is:");
 
@@ -222,23 +326,45 @@ int main(int argc, char *argv[])
     //     printf("\n");
 
     //     for (j = 0; j < N; j++)
-    //         printf("%d ", distances[i][j]);
+    //         printf("%d ", distance(i, j));
     // }
     // printf("\n");
 
-    while ((clock() - start) / CLOCKS_PER_SEC < 60)
+    // Tour buffers plus room for checking the result
+    size_t bytes = (3 * (size_t)N + 1) * sizeof(int) + (N + 63) / 64 * sizeof(uint64_t) + 5 * ARENA_ALIGN;
+    if (arenaReserve(&workspace, bytes) != 0)
+    {
+        printf("Error mapping the workspace.\n");
+        return 1;
+    }
+    TourScratch scratch;
+    scratch.tour = arenaAlloc(&workspace, (N + 1) * sizeof(int));
+    scratch.visited = arenaCalloc(&workspace, N * sizeof(int));
+    scratch.row = arenaAlloc(&workspace, N * sizeof(int));
+    scratch.stamp = 0;
+
+    while ((clock() - start) / CLOCKS_PER_SEC < time_limit)
     {
-        // Array to keep track of which cities have been visited
-        int visited[N] = {0};
+        global_mincost = findMinCost(&scratch);
 
-        global_mincost = findMinCost(visited);
+    }
 
+    // Check the reported tour before printing it
+    tracePhaseBegin("validateTour");
+    int valid = global_count == N + 1 && validateTour(global_visited_cities) && tourCost(global_visited_cities) == global_mincost;
+    traceEnd();
+    if (!valid)
+    {
+        printf("Error: the best tour is not a valid tour of cost %ld.\n", global_mincost);
+        return 1;
     }
 
-    printf("Minimum cost: %d\n", global_mincost);
+    printf("Minimum cost: %ld\n", global_mincost);
 
     printf("The number of cities traversed: %d\n", global_count);
 
+    printf("Tours constructed: %ld\n", global_tours);
+
     printf("The list of cities reversed in order: ");
     for (i = 0; i < global_count; i++)
     {
@@ -253,5 +379,17 @@ int main(int argc, char *argv[])
 
     printf("\n");
 
+    if (trace_file != NULL)
+    {
+        long events = traceWrite(trace_file);
+        if (events < 0)
+        {
+            printf("Error writing %s.\n", trace_file);
+            return 1;
+        }
+        printf("Wrote %ld trace events to %s\n", events, trace_file);
+        traceFree();
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+/**
+ * @file arena.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Workspace arena, see arena.h.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+// Function to map an arena on huge pages when they are available, or on base pages only
+static int arenaMap(Arena *arena, size_t bytes, int huge)
+{
+    memset(arena, 0, sizeof(*arena));
+    if (bytes == 0)
+    {
+        return 0;
+    }
+    size_t page = huge ? ARENA_HUGE_PAGE : ARENA_PAGE;
+    size_t size = (bytes + page - 1) / page * page;
+    void *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // Only succeeds when huge pages are reserved (vm.nr_hugepages)
+    if (huge)
+    {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        arena->pages = ARENA_HUGETLB;
+    }
+#endif
+    if (base == MAP_FAILED)
+    {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            return -1;
+        }
+        arena->pages = ARENA_SMALL;
+#ifdef MADV_HUGEPAGE
+        if (huge && madvise(base, size, MADV_HUGEPAGE) == 0)
+        {
+            arena->pages = ARENA_THP;
+        }
+#endif
+#ifdef MADV_NOHUGEPAGE
+        if (!huge)
+        {
+            madvise(base, size, MADV_NOHUGEPAGE);
+        }
+#endif
+    }
+    arena->base = base;
+    arena->size = size;
+    return 0;
+}
+
+int arenaInit(Arena *arena, size_t bytes)
+{
+    return arenaMap(arena, bytes, 1);
+}
+
+int arenaInitSmall(Arena *arena, size_t bytes)
+{
+    return arenaMap(arena, bytes, 0);
+}
+
+int arenaReserve(Arena *arena, size_t bytes)
+{
+    if (arena->base != NULL && arena->size >= bytes)
+    {
+        return 0;
+    }
+    arenaFree(arena);
+    return arenaInit(arena, bytes);
+}
+
+void *arenaAlloc(Arena *arena, size_t bytes)
+{
+    size_t start = (arena->used + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (start + bytes > arena->size)
+    {
+        printf("Workspace of %zu bytes exhausted by a request for %zu more.\n", arena->size, bytes);
+        exit(1);
+    }
+    arena->used = start + bytes;
+    arena->peak = arena->used > arena->peak ? arena->used : arena->peak;
+    return arena->base + start;
+}
+
+void *arenaCalloc(Arena *arena, size_t bytes)
+{
+    void *p = arenaAlloc(arena, bytes);
+    memset(p, 0, bytes);
+    return p;
+}
+
+size_t arenaMark(const Arena *arena)
+{
+    return arena->used;
+}
+
+void arenaRelease(Arena *arena, size_t mark)
+{
+    arena->used = mark;
+}
+
+void arenaReset(Arena *arena)
+{
+    arena->used = 0;
+}
+
+void arenaFree(Arena *arena)
+{
+    if (arena->base != NULL)
+    {
+        munmap(arena->base, arena->size);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+const char *arenaPagesName(const Arena *arena)
+{
+    return arena->pages == ARENA_HUGETLB ? "hugetlb" : arena->pages == ARENA_THP ? "thp" : "4k";
+}
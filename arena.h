@@ -0,0 +1,65 @@
+/**
+ * @file arena.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Workspace arena. One mapping is sized once per problem and handed out by bumping an
+ * offset; a solver takes a mark on entry and releases back to it on exit (or the driver resets
+ * the arena between calls), so repeated calls make no allocations. The mapping uses reserved
+ * huge pages (MAP_HUGETLB) when the system has them and otherwise asks for transparent huge
+ * pages; arenaInitSmall maps one on 4 KB pages instead, for data whose NUMA placement is
+ * decided page by page by the thread that first touches it. Not thread safe: carve
+ * per-thread pieces before entering a parallel region. Build a program with it by adding
+ * arena.c to its compile line.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Alignment of every allocation, one cache line
+#define ARENA_ALIGN 64
+#define ARENA_HUGE_PAGE (2 << 20)
+#define ARENA_PAGE 4096
+
+typedef enum
+{
+    ARENA_NONE,
+    ARENA_HUGETLB,
+    ARENA_THP,
+    ARENA_SMALL
+} ArenaPages;
+
+typedef struct
+{
+    char *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    ArenaPages pages;
+} Arena;
+
+// Map an arena of at least bytes; returns 0 on success
+int arenaInit(Arena *arena, size_t bytes);
+
+// As arenaInit, on 4 KB pages with transparent huge pages refused. Its pages are untouched;
+// arenaReserve would remap it on huge pages, so remap it with arenaFree and arenaInitSmall
+int arenaInitSmall(Arena *arena, size_t bytes);
+
+// Make the arena at least bytes, remapping it (and dropping its contents) if it is smaller
+int arenaReserve(Arena *arena, size_t bytes);
+
+// Bytes of aligned allocations, exits when the arena is exhausted since it was sized too small
+void *arenaAlloc(Arena *arena, size_t bytes);
+void *arenaCalloc(Arena *arena, size_t bytes);
+
+// Release everything allocated after a mark, or everything
+size_t arenaMark(const Arena *arena);
+void arenaRelease(Arena *arena, size_t mark);
+void arenaReset(Arena *arena);
+
+void arenaFree(Arena *arena);
+
+// "hugetlb", "thp" or "4k" for reports
+const char *arenaPagesName(const Arena *arena);
+
+#endif
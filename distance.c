@@ -0,0 +1,429 @@
+/**
+ * @file distance.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Distance tables for the TSP programs, see distance.h.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "distance.h"
+
+// Entries of a packed or full layout for capacity cities
+static size_t distanceEntries(int capacity, int packed)
+{
+    return packed ? (size_t)capacity * (capacity + 1) / 2 : (size_t)capacity * capacity;
+}
+
+// Allocate a table of n cities laid out for capacity cities
+static void distanceTableLayout(DistanceTable *table, int n, int capacity, int packed, int wide)
+{
+    size_t entries = distanceEntries(capacity, packed);
+    memset(table, 0, sizeof(*table));
+    table->kind = packed ? (wide ? DISTANCE_PACKED32 : DISTANCE_PACKED16) : (wide ? DISTANCE_FULL32 : DISTANCE_FULL16);
+    table->n = n;
+    table->capacity = capacity;
+    if (wide)
+        table->d32 = malloc(entries * sizeof(uint32_t));
+    else
+        table->d16 = malloc(entries * sizeof(uint16_t));
+    table->row = malloc(capacity * sizeof(long));
+    for (int i = 0; i < capacity; i++)
+    {
+        // Packed row i holds capacity - i entries starting at column i
+        table->row[i] = packed ? (long)i * (2L * capacity - i + 1) / 2 - i : (long)i * capacity;
+    }
+}
+
+void distanceTableAlloc(DistanceTable *table, int n, int packed, int wide)
+{
+    distanceTableLayout(table, n, n, packed, wide);
+}
+
+void distanceTableGeometric(DistanceTable *table, int n)
+{
+    memset(table, 0, sizeof(*table));
+    table->kind = DISTANCE_GEOMETRIC;
+    table->n = n;
+    table->capacity = n;
+    table->x = malloc(n * sizeof(double));
+    table->y = malloc(n * sizeof(double));
+}
+
+void distanceTableFree(DistanceTable *table)
+{
+    free(table->d16);
+    free(table->d32);
+    free(table->row);
+    free(table->x);
+    free(table->y);
+    memset(table, 0, sizeof(*table));
+}
+
+// Store entry k of a packed or full table
+static inline void distanceSet(DistanceTable *table, long k, uint32_t d)
+{
+    if (distanceWide(table))
+        table->d32[k] = d;
+    else
+        table->d16[k] = (uint16_t)d;
+}
+
+// Read a packed distance file one row at a time, putting back the diagonal
+static int loadPackedDistances(DistanceTable *table, FILE *file)
+{
+    DistanceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DISTANCE_MAGIC, 4) != 0 ||
+        header.n < 2 || (header.width != 2 && header.width != 4))
+    {
+        return 0;
+    }
+    int n = header.n;
+    distanceTableAlloc(table, n, 1, header.width == 4);
+    for (int i = 0; i < n; i++)
+    {
+        long k = table->row[i] + i;
+        distanceSet(table, k, 0);
+        size_t count = n - 1 - i;
+        void *data = distanceWide(table) ? (void *)(table->d32 + k + 1) : (void *)(table->d16 + k + 1);
+        if (fread(data, header.width, count, file) != count)
+        {
+            distanceTableFree(table);
+            return 0;
+        }
+    }
+    return n;
+}
+
+int distanceTableLoad(DistanceTable *table, const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    char magic[4];
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, DISTANCE_MAGIC, 4) == 0)
+    {
+        rewind(file);
+        int loaded = loadPackedDistances(table, file);
+        fclose(file);
+        return loaded;
+    }
+    rewind(file);
+
+    // Count the columns of the first row, ignoring a trailing comma
+    int c, last = 0;
+    int n = 1;
+    while ((c = fgetc(file)) != EOF && c != '\n')
+    {
+        if (c == ',')
+            n++;
+        if (c != '\r' && c != ' ')
+            last = c;
+    }
+    if (last == ',')
+        n--;
+
+    // A first pass checks every entry and finds the width, so nothing but the table is held
+    rewind(file);
+    int largest = 0;
+    for (size_t k = 0; k < (size_t)n * n; k++)
+    {
+        int d;
+        if (fscanf(file, "%d ,", &d) != 1 || d < 0)
+        {
+            fclose(file);
+            return 0;
+        }
+        largest = d > largest ? d : largest;
+    }
+    int wide = largest > UINT16_MAX;
+
+    // The second pass stores rows in the packed triangle and checks each one against the
+    // triangle read so far. At the first row that breaks symmetry the rows before it are
+    // expanded into a full table, which takes the rest of the file
+    rewind(file);
+    int *line = malloc(n * sizeof(int));
+    distanceTableAlloc(table, n, 1, wide);
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            if (fscanf(file, "%d ,", &line[j]) != 1)
+            {
+                fclose(file);
+                free(line);
+                distanceTableFree(table);
+                return 0;
+            }
+        }
+
+        if (distancePacked(table))
+        {
+            int symmetric = line[i] == 0;
+            for (int j = 0; j < i && symmetric; j++)
+            {
+                symmetric = distanceAt(table, j, i) == line[j];
+            }
+            if (!symmetric)
+            {
+                DistanceTable full;
+                distanceTableAlloc(&full, n, 0, wide);
+                for (int r = 0; r < i; r++)
+                {
+                    for (int j = 0; j < n; j++)
+                    {
+                        distanceSet(&full, full.row[r] + j, distanceAt(table, r, j));
+                    }
+                }
+                distanceTableFree(table);
+                *table = full;
+            }
+        }
+
+        for (int j = distancePacked(table) ? i : 0; j < n; j++)
+        {
+            distanceSet(table, table->row[i] + j, line[j]);
+        }
+    }
+    free(line);
+    fclose(file);
+
+    return n;
+}
+
+int distanceTableWrite(const DistanceTable *table, const char *filename)
+{
+    if (!distancePacked(table))
+    {
+        return -1;
+    }
+    DistanceHeader header;
+    memcpy(header.magic, DISTANCE_MAGIC, 4);
+    header.n = table->n;
+    header.width = distanceWide(table) ? 4 : 2;
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < table->n - 1 && ok; i++)
+    {
+        long k = table->row[i] + i + 1;
+        size_t count = table->n - 1 - i;
+        const void *data = distanceWide(table) ? (const void *)(table->d32 + k) : (const void *)(table->d16 + k);
+        ok = fwrite(data, header.width, count, file) == count;
+    }
+    if (fclose(file) != 0)
+    {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+void distanceTableResize(DistanceTable *table, int n, int wide, int thread_count)
+{
+    int packed = distancePacked(table);
+    if (n <= table->capacity && wide == distanceWide(table))
+    {
+        // Clear the entries of the cities coming into the table, which may hold old values
+        // if it shrank before: columns old n .. n - 1 of the old rows, then the new rows
+        int old_n = table->n;
+        table->n = n;
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 16)
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = i < old_n ? old_n : (packed ? i : 0); j < n; j++)
+            {
+                distanceSet(table, table->row[i] + j, 0);
+            }
+        }
+        return;
+    }
+
+    DistanceTable old = *table;
+    int common = old.n < n ? old.n : n;
+    int capacity = n > old.capacity ? (int)(old.capacity * DISTANCE_GROWTH) + 1 : old.capacity;
+    capacity = capacity > n ? capacity : n;
+    distanceTableLayout(table, n, capacity, packed, wide);
+    size_t entries = distanceEntries(capacity, packed);
+    if (wide)
+        memset(table->d32, 0, entries * sizeof(uint32_t));
+    else
+        memset(table->d16, 0, entries * sizeof(uint16_t));
+
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 16)
+    for (int i = 0; i < common; i++)
+    {
+        for (int j = packed ? i : 0; j < common; j++)
+        {
+            distanceSet(table, table->row[i] + j, distanceAt(&old, i, j));
+        }
+    }
+    distanceTableFree(&old);
+}
+
+void distanceStore(DistanceTable *table, int i, int j, int d, int thread_count)
+{
+    if (i == j)
+        return;
+    if ((uint32_t)d > UINT16_MAX && !distanceWide(table))
+    {
+        distanceTableResize(table, table->n, 1, thread_count);
+    }
+    distanceSet(table, distanceIndex(table, i, j), d);
+}
+
+// Rows of the packed triangle: columns before i are read down column i of the rows above,
+// the rest is the contiguous tail of row i
+static void packedRow16(const DistanceTable *table, int i, int from, int to, int *out)
+{
+    int split = to < i ? to : i;
+    for (int k = from; k < split; k++)
+        out[k - from] = table->d16[table->row[k] + i];
+    const uint16_t *tail = table->d16 + table->row[i];
+#pragma omp simd
+    for (int k = from > i ? from : i; k < to; k++)
+        out[k - from] = tail[k];
+}
+
+static void packedRow32(const DistanceTable *table, int i, int from, int to, int *out)
+{
+    int split = to < i ? to : i;
+    for (int k = from; k < split; k++)
+        out[k - from] = (int)table->d32[table->row[k] + i];
+    const uint32_t *tail = table->d32 + table->row[i];
+#pragma omp simd
+    for (int k = from > i ? from : i; k < to; k++)
+        out[k - from] = (int)tail[k];
+}
+
+void distanceRow(const DistanceTable *table, int i, int from, int to, int *out)
+{
+    switch (table->kind)
+    {
+    case DISTANCE_GEOMETRIC:
+    {
+        const double *x = table->x, *y = table->y;
+        double xi = x[i], yi = y[i];
+#pragma omp simd
+        for (int k = from; k < to; k++)
+        {
+            double dx = x[k] - xi, dy = y[k] - yi;
+            out[k - from] = (int)(sqrt(dx * dx + dy * dy) + 0.5);
+        }
+        break;
+    }
+    case DISTANCE_PACKED16:
+        packedRow16(table, i, from, to, out);
+        break;
+    case DISTANCE_PACKED32:
+        packedRow32(table, i, from, to, out);
+        break;
+    case DISTANCE_FULL16:
+    {
+        const uint16_t *r = table->d16 + table->row[i];
+#pragma omp simd
+        for (int k = from; k < to; k++)
+            out[k - from] = r[k];
+        break;
+    }
+    case DISTANCE_FULL32:
+    {
+        const uint32_t *r = table->d32 + table->row[i];
+#pragma omp simd
+        for (int k = from; k < to; k++)
+            out[k - from] = (int)r[k];
+        break;
+    }
+    }
+}
+
+void distanceColumn(const DistanceTable *table, int j, int from, int to, int *out)
+{
+    if (distanceSymmetric(table))
+    {
+        distanceRow(table, j, from, to, out);
+    }
+    else if (table->kind == DISTANCE_FULL16)
+    {
+        for (int k = from; k < to; k++)
+            out[k - from] = table->d16[table->row[k] + j];
+    }
+    else
+    {
+        for (int k = from; k < to; k++)
+            out[k - from] = (int)table->d32[table->row[k] + j];
+    }
+}
+
+// A tour's entries are gathered from the raw arrays, one loop per kind. Packed indices take
+// the smaller city's row with min / max rather than a branch, so every loop vectorises
+long distanceTourCost(const DistanceTable *table, const int *tour, int n)
+{
+    long cost = 0;
+    const long *row = table->row;
+    switch (table->kind)
+    {
+    case DISTANCE_GEOMETRIC:
+    {
+        const double *x = table->x, *y = table->y;
+#pragma omp simd reduction(+ : cost)
+        for (int k = 0; k < n; k++)
+        {
+            double dx = x[tour[k + 1]] - x[tour[k]], dy = y[tour[k + 1]] - y[tour[k]];
+            cost += (int)(sqrt(dx * dx + dy * dy) + 0.5);
+        }
+        break;
+    }
+    case DISTANCE_PACKED16:
+    {
+        const uint16_t *d = table->d16;
+#pragma omp simd reduction(+ : cost)
+        for (int k = 0; k < n; k++)
+        {
+            int a = tour[k], b = tour[k + 1];
+            int lo = a < b ? a : b, hi = a < b ? b : a;
+            cost += d[row[lo] + hi];
+        }
+        break;
+    }
+    case DISTANCE_PACKED32:
+    {
+        const uint32_t *d = table->d32;
+#pragma omp simd reduction(+ : cost)
+        for (int k = 0; k < n; k++)
+        {
+            int a = tour[k], b = tour[k + 1];
+            int lo = a < b ? a : b, hi = a < b ? b : a;
+            cost += d[row[lo] + hi];
+        }
+        break;
+    }
+    case DISTANCE_FULL16:
+    {
+        const uint16_t *d = table->d16;
+#pragma omp simd reduction(+ : cost)
+        for (int k = 0; k < n; k++)
+        {
+            cost += d[row[tour[k]] + tour[k + 1]];
+        }
+        break;
+    }
+    case DISTANCE_FULL32:
+    {
+        const uint32_t *d = table->d32;
+#pragma omp simd reduction(+ : cost)
+        for (int k = 0; k < n; k++)
+        {
+            cost += d[row[tour[k]] + tour[k + 1]];
+        }
+        break;
+    }
+    }
+    return cost;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file distance.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Distance tables for the TSP programs. A symmetric matrix is stored once per pair as a packed
+ * upper triangle with its zero diagonal (row i holds columns i .. n - 1), an asymmetric one as
+ * the full n x n matrix, in uint16 when every distance fits and uint32 when not. A geometric
+ * table stores only the city coordinates and rounds their Euclidean distance on every lookup.
+ * The kind is fixed when the table is built. distanceAt reads one entry and switches on the
+ * kind, so hot loops instead fetch whole rows or columns with distanceRow / distanceColumn,
+ * whose loops are specialised per kind, and scan those. Build a program with it by adding
+ * distance.c to its compile line.
+ */
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Header of a packed distance file: magic, number of cities and bytes per entry,
+// followed by the n * (n - 1) / 2 upper triangle entries row by row, without the diagonal
+#define DISTANCE_MAGIC "TSPD"
+typedef struct
+{
+    char magic[4];
+    int32_t n;
+    int32_t width;
+} DistanceHeader;
+
+typedef enum
+{
+    DISTANCE_PACKED16,
+    DISTANCE_PACKED32,
+    DISTANCE_FULL16,
+    DISTANCE_FULL32,
+    DISTANCE_GEOMETRIC
+} DistanceKind;
+
+typedef struct
+{
+    DistanceKind kind;
+    int n;
+    int capacity; // cities the layout has room for; rows are laid out for capacity cities
+    uint16_t *d16;
+    uint32_t *d32;
+    long *row; // index of column 0 of row i; packed rows start at column i
+    double *x; // coordinates of a geometric table
+    double *y;
+} DistanceTable;
+
+// Allocate a table for n cities, packed (symmetric) or full, uint32 when wide. The
+// entries are not cleared
+void distanceTableAlloc(DistanceTable *table, int n, int packed, int wide);
+
+// Allocate a geometric table for n cities; the caller fills x and y
+void distanceTableGeometric(DistanceTable *table, int n);
+
+void distanceTableFree(DistanceTable *table);
+
+// Read a CSV matrix, row by row straight into the packed table while it stays symmetric, or
+// a packed file written by distanceTableWrite. Returns the number of cities or 0
+int distanceTableLoad(DistanceTable *table, const char *filename);
+
+// Write a packed table as a packed distance file. Returns 0 on success
+int distanceTableWrite(const DistanceTable *table, const char *filename);
+
+// Grow (or shrink) a stored table to n cities and/or widen it, keeping the common entries;
+// new entries are 0. Within the capacity only the new entries are touched; past it the table
+// is copied into one with DISTANCE_GROWTH times the room, so adding cities one at a time
+// costs amortised O(n) each
+#define DISTANCE_GROWTH 1.125
+void distanceTableResize(DistanceTable *table, int n, int wide, int thread_count);
+
+// Store d(i, j), widening the table on thread_count threads when d does not fit. A packed
+// table stores the pair once
+void distanceStore(DistanceTable *table, int i, int j, int d, int thread_count);
+
+// out[k - from] = d(i, k) and d(k, i) for from <= k < to
+void distanceRow(const DistanceTable *table, int i, int from, int to, int *out);
+void distanceColumn(const DistanceTable *table, int j, int from, int to, int *out);
+
+// Cost of the closed walk tour[0] -> ... -> tour[n], summed in long
+long distanceTourCost(const DistanceTable *table, const int *tour, int n);
+
+static inline int distancePacked(const DistanceTable *table)
+{
+    return table->kind == DISTANCE_PACKED16 || table->kind == DISTANCE_PACKED32;
+}
+
+static inline int distanceWide(const DistanceTable *table)
+{
+    return table->kind == DISTANCE_PACKED32 || table->kind == DISTANCE_FULL32;
+}
+
+static inline int distanceSymmetric(const DistanceTable *table)
+{
+    return table->kind != DISTANCE_FULL16 && table->kind != DISTANCE_FULL32;
+}
+
+// Rounded Euclidean distance of a geometric table, for loops that know the kind
+static inline int distanceGeometric(const DistanceTable *table, int i, int j)
+{
+    double dx = table->x[i] - table->x[j], dy = table->y[i] - table->y[j];
+    return (int)(sqrt(dx * dx + dy * dy) + 0.5);
+}
+
+// Index of entry (i, j) of a packed or full table
+static inline long distanceIndex(const DistanceTable *table, int i, int j)
+{
+    if (distancePacked(table))
+    {
+        int lo = i < j ? i : j, hi = i < j ? j : i;
+        return table->row[lo] + hi;
+    }
+    return table->row[i] + j;
+}
+
+static inline int distanceAt(const DistanceTable *table, int i, int j)
+{
+    switch (table->kind)
+    {
+    case DISTANCE_GEOMETRIC:
+        return distanceGeometric(table, i, j);
+    case DISTANCE_PACKED16:
+    case DISTANCE_FULL16:
+        return table->d16[distanceIndex(table, i, j)];
+    default:
+        return (int)table->d32[distanceIndex(table, i, j)];
+    }
+}
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file gemm.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Packed-panel GEMM. For each GEMM_NC wide panel of B and GEMM_KC deep slice of k, the
+ * threads pack the B slice into GEMM_NR wide strips, then share out GEMM_MC tall blocks of
+ * A: each thread packs its block into GEMM_MR tall strips and runs the micro-kernel over
+ * every strip pair. Packed strips are read contiguously by the micro-kernel, which keeps a
+ * GEMM_MR x GEMM_NR tile of C in vector registers for the whole slice.
+ *
+ * Compile with -O3 -march=native -ffp-contract=fast so the kernel uses the widest vectors
+ * and fused multiply-adds available.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "gemm.h"
+
+// Four doubles, mapped by the compiler onto whatever SIMD registers the target has
+typedef double v4d __attribute__((vector_size(32)));
+
+// Function to copy an mc x kc block of A into GEMM_MR tall strips, column by column within
+// a strip and zero-padded to a whole strip
+static void packA(int mc, int kc, const double *a, int lda, double *packed)
+{
+    for (int i0 = 0; i0 < mc; i0 += GEMM_MR)
+    {
+        int rows = mc - i0 < GEMM_MR ? mc - i0 : GEMM_MR;
+        for (int p = 0; p < kc; p++)
+        {
+            for (int r = 0; r < GEMM_MR; r++)
+            {
+                *packed++ = r < rows ? a[(size_t)(i0 + r) * lda + p] : 0.0;
+            }
+        }
+    }
+}
+
+// Function to copy GEMM_NR wide strips of a kc x nc slice of B, row by row within a strip and
+// zero-padded to a whole strip. Strips are shared out over the calling team
+static void packB(int kc, int nc, const double *b, int ldb, double *packed)
+{
+    int strips = (nc + GEMM_NR - 1) / GEMM_NR;
+#pragma omp for schedule(static)
+    for (int s = 0; s < strips; s++)
+    {
+        int j0 = s * GEMM_NR;
+        int cols = nc - j0 < GEMM_NR ? nc - j0 : GEMM_NR;
+        double *out = packed + (size_t)s * kc * GEMM_NR;
+        for (int p = 0; p < kc; p++)
+        {
+            const double *row = b + (size_t)p * ldb + j0;
+            for (int c = 0; c < GEMM_NR; c++)
+            {
+                *out++ = c < cols ? row[c] : 0.0;
+            }
+        }
+    }
+}
+
+// Micro-kernel: C[0..rows, 0..cols] += alpha * (packed A strip) * (packed B strip), written out
+// for GEMM_MR = 4 and GEMM_NR = 8 as eight four-wide accumulators
+static void microKernel(int kc, double alpha, const double *pa, const double *pb, double *c, int ldc, int rows, int cols)
+{
+    v4d c00 = {0}, c01 = {0}, c10 = {0}, c11 = {0}, c20 = {0}, c21 = {0}, c30 = {0}, c31 = {0};
+
+    for (int p = 0; p < kc; p++)
+    {
+        v4d b0, b1;
+        memcpy(&b0, pb, sizeof(v4d));
+        memcpy(&b1, pb + 4, sizeof(v4d));
+        c00 += pa[0] * b0;
+        c01 += pa[0] * b1;
+        c10 += pa[1] * b0;
+        c11 += pa[1] * b1;
+        c20 += pa[2] * b0;
+        c21 += pa[2] * b1;
+        c30 += pa[3] * b0;
+        c31 += pa[3] * b1;
+        pa += GEMM_MR;
+        pb += GEMM_NR;
+    }
+
+    double tile[GEMM_MR][GEMM_NR];
+    memcpy(&tile[0][0], &c00, sizeof(v4d));
+    memcpy(&tile[0][4], &c01, sizeof(v4d));
+    memcpy(&tile[1][0], &c10, sizeof(v4d));
+    memcpy(&tile[1][4], &c11, sizeof(v4d));
+    memcpy(&tile[2][0], &c20, sizeof(v4d));
+    memcpy(&tile[2][4], &c21, sizeof(v4d));
+    memcpy(&tile[3][0], &c30, sizeof(v4d));
+    memcpy(&tile[3][4], &c31, sizeof(v4d));
+
+    for (int r = 0; r < rows; r++)
+    {
+        double *crow = c + (size_t)r * ldc;
+        for (int j = 0; j < cols; j++)
+        {
+            crow[j] += alpha * tile[r][j];
+        }
+    }
+}
+
+void gemm(int m, int n, int k, double alpha, const double *a, int lda, const double *b, int ldb,
+          double beta, double *c, int ldc)
+{
+    if (m <= 0 || n <= 0)
+    {
+        return;
+    }
+
+    double *packed_b = NULL;
+    size_t b_size = (size_t)GEMM_KC * ((GEMM_NC + GEMM_NR - 1) / GEMM_NR * GEMM_NR) * sizeof(double);
+    if (k > 0 && alpha != 0 && posix_memalign((void **)&packed_b, 64, b_size) != 0)
+    {
+        abort();
+    }
+
+#pragma omp parallel
+    {
+        if (beta != 1.0)
+        {
+#pragma omp for schedule(static)
+            for (int i = 0; i < m; i++)
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    c[(size_t)i * ldc + j] = beta == 0.0 ? 0.0 : beta * c[(size_t)i * ldc + j];
+                }
+            }
+        }
+
+        double *packed_a = NULL;
+        if (packed_b != NULL && posix_memalign((void **)&packed_a, 64, (size_t)GEMM_MC * GEMM_KC * sizeof(double)) != 0)
+        {
+            abort();
+        }
+
+        for (int jc = 0; packed_b != NULL && jc < n; jc += GEMM_NC)
+        {
+            int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+            for (int pc = 0; pc < k; pc += GEMM_KC)
+            {
+                int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+
+                // The implicit barriers after packB and the block loop keep the slices apart
+                packB(kc, nc, b + (size_t)pc * ldb + jc, ldb, packed_b);
+
+#pragma omp for schedule(dynamic, 1)
+                for (int ic = 0; ic < m; ic += GEMM_MC)
+                {
+                    int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                    packA(mc, kc, a + (size_t)ic * lda + pc, lda, packed_a);
+
+                    for (int jr = 0; jr < nc; jr += GEMM_NR)
+                    {
+                        const double *pb = packed_b + (size_t)(jr / GEMM_NR) * kc * GEMM_NR;
+                        int cols = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                        for (int ir = 0; ir < mc; ir += GEMM_MR)
+                        {
+                            int rows = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                            microKernel(kc, alpha, packed_a + (size_t)(ir / GEMM_MR) * kc * GEMM_MR, pb,
+                                        c + (size_t)(ic + ir) * ldc + jc + jr, ldc, rows, cols);
+                        }
+                    }
+                }
+            }
+        }
+        free(packed_a);
+    }
+    free(packed_b);
+}
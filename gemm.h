@@ -0,0 +1,24 @@
+/**
+ * @file gemm.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Packed-panel matrix multiply in the BLIS/GotoBLAS style for row-major doubles.
+ * Build it into a program by adding gemm.c to its compile line.
+ */
+#ifndef GEMM_H
+#define GEMM_H
+
+// Micro-tile of C kept in registers (GEMM_MR rows x GEMM_NR columns), and the cache blocks:
+// a GEMM_MC x GEMM_KC block of A is packed to stay in L2, a GEMM_KC x GEMM_NC panel of B in L3
+#define GEMM_MR 4
+#define GEMM_NR 8
+#define GEMM_MC 128
+#define GEMM_KC 256
+#define GEMM_NC 2048
+
+// C = alpha * A * B + beta * C, with A m x k, B k x n and C m x n, all row-major with
+// leading dimensions lda, ldb and ldc. Runs on the current OpenMP team size
+void gemm(int m, int n, int k, double alpha, const double *a, int lda, const double *b, int ldb,
+          double beta, double *c, int ldc);
+
+#endif
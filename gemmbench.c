@@ -0,0 +1,184 @@
+/**
+ * @file gemmbench.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Correctness and speed checks for gemm.c. Every size is checked against a plain triple
+ * loop (including sizes that leave partial micro-tiles and cache blocks), then timed and
+ * reported in GFLOP/s next to the rank-1 update sweep the LU loops use for the same work.
+ *
+ * Compile:  gcc -Wall -O3 -march=native -ffp-contract=fast -fopenmp -std=c99 -o gemmbench.o gemmbench.c gemm.c -lm
+ * Usage: ./gemmbench.o [-n size] [-k depth] [-r repetitions]
+ *        without -n the sizes 127, 256, 512, 1000, 1024 and 2048 are run, each with k = n unless -k is given
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "gemm.h"
+
+// Largest size checked against the triple loop
+#define CHECK_MAX 1024
+
+// Function to fill a matrix with uniform values in [-1, 1], not all exact binary fractions
+// so the checks see rounding differences
+void fillRandom(double *a, size_t count, unsigned int seed)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        a[i] = (seed >> 8) / 16777213.0 * 2.0 - 1.0;
+    }
+}
+
+// Function to compute C = alpha * A * B + beta * C with plain loops
+void gemmReference(int m, int n, int k, double alpha, const double *a, const double *b, double beta, double *c)
+{
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < m; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            double sum = 0;
+            for (int p = 0; p < k; p++)
+            {
+                sum += a[(size_t)i * k + p] * b[(size_t)p * n + j];
+            }
+            c[(size_t)i * n + j] = alpha * sum + beta * c[(size_t)i * n + j];
+        }
+    }
+}
+
+// Function to apply the same update as k rank-1 row sweeps, the way the LU loops do
+void rankOneUpdates(int m, int n, int k, const double *a, const double *b, double *c)
+{
+    for (int p = 0; p < k; p++)
+    {
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < m; i++)
+        {
+            double factor = a[(size_t)i * k + p];
+            double *crow = c + (size_t)i * n;
+            const double *brow = b + (size_t)p * n;
+            for (int j = 0; j < n; j++)
+            {
+                crow[j] -= factor * brow[j];
+            }
+        }
+    }
+}
+
+// Function to check gemm against the reference, returns the largest relative difference
+double checkSize(int m, int n, int k, double alpha, double beta)
+{
+    double *a = malloc((size_t)m * k * sizeof(double) + 8);
+    double *b = malloc((size_t)k * n * sizeof(double) + 8);
+    double *c = malloc((size_t)m * n * sizeof(double) + 8);
+    double *expect = malloc((size_t)m * n * sizeof(double) + 8);
+    fillRandom(a, (size_t)m * k, 1);
+    fillRandom(b, (size_t)k * n, 2);
+    fillRandom(c, (size_t)m * n, 3);
+    memcpy(expect, c, (size_t)m * n * sizeof(double));
+
+    gemm(m, n, k, alpha, a, k, b, n, beta, c, n);
+    gemmReference(m, n, k, alpha, a, b, beta, expect);
+
+    double worst = 0;
+    for (size_t i = 0; i < (size_t)m * n; i++)
+    {
+        double diff = fabs(c[i] - expect[i]) / (1.0 + fabs(expect[i]));
+        if (diff > worst)
+        {
+            worst = diff;
+        }
+    }
+    free(a);
+    free(b);
+    free(c);
+    free(expect);
+    return worst;
+}
+
+int main(int argc, char *argv[])
+{
+    int sizes[] = {127, 256, 512, 1000, 1024, 2048};
+    int count = 6;
+    int depth = 0;
+    int repetitions = 3;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            sizes[0] = strtol(argv[++i], NULL, 10);
+            count = 1;
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            depth = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            repetitions = strtol(argv[++i], NULL, 10);
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Odd shapes exercise the partial tiles, a k past GEMM_KC and an m past GEMM_MC the blocking
+    int shapes[][3] = {{1, 1, 1}, {3, 7, 5}, {5, 9, 300}, {129, 17, 33}, {200, 301, 513}, {64, 2100, 16}};
+    int failed = 0;
+    printf("===GEMM CORRECTNESS - %d THREADS===\n", omp_get_max_threads());
+    for (int s = 0; s < 6; s++)
+    {
+        double error = checkSize(shapes[s][0], shapes[s][1], shapes[s][2], -1.0, 1.0);
+        double scaled = checkSize(shapes[s][0], shapes[s][1], shapes[s][2], 0.5, 0.25);
+        printf("%4d x %4d x %4d: max relative error %.2e / %.2e %s\n", shapes[s][0], shapes[s][1], shapes[s][2],
+               error, scaled, error < 1e-12 && scaled < 1e-12 ? "ok" : "FAILED");
+        failed += !(error < 1e-12 && scaled < 1e-12);
+    }
+
+    printf("\n===GEMM SPEED - %d THREADS===\n", omp_get_max_threads());
+    for (int s = 0; s < count; s++)
+    {
+        int n = sizes[s];
+        int k = depth > 0 ? depth : n;
+        double *a = malloc((size_t)n * k * sizeof(double));
+        double *b = malloc((size_t)k * n * sizeof(double));
+        double *c = calloc((size_t)n * n, sizeof(double));
+        fillRandom(a, (size_t)n * k, 4);
+        fillRandom(b, (size_t)k * n, 5);
+
+        if (n <= CHECK_MAX)
+        {
+            double error = checkSize(n, n, k, -1.0, 1.0);
+            printf("%4d x %4d x %4d: max relative error %.2e %s\n", n, n, k, error, error < 1e-12 ? "ok" : "FAILED");
+            failed += !(error < 1e-12);
+        }
+
+        double flops = 2.0 * n * n * k;
+        double best = 1e30, best_rank1 = 1e30;
+        for (int r = 0; r < repetitions; r++)
+        {
+            double start = omp_get_wtime();
+            gemm(n, n, k, -1.0, a, k, b, n, 1.0, c, n);
+            double t = omp_get_wtime() - start;
+            best = t < best ? t : best;
+
+            start = omp_get_wtime();
+            rankOneUpdates(n, n, k, a, b, c);
+            t = omp_get_wtime() - start;
+            best_rank1 = t < best_rank1 ? t : best_rank1;
+        }
+        printf("%4d x %4d x %4d: gemm %.3fs %.2f GFLOP/s, rank-1 sweeps %.3fs %.2f GFLOP/s\n",
+               n, n, k, best, flops / best * 1e-9, best_rank1, flops / best_rank1 * 1e-9);
+        free(a);
+        free(b);
+        free(c);
+    }
+
+    return failed != 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file heldkarp.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Held-Karp lower bound for the TSP programs, see heldkarp.h.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <omp.h>
+#include "heldkarp.h"
+
+// A thread's cheapest city outside the tree during a Prim step, a cache line of its own
+typedef struct
+{
+    double key;
+    int city;
+    char pad[64 - sizeof(double) - sizeof(int)];
+} PrimOffer;
+
+size_t heldKarpBytes(int n, int thread_count)
+{
+    return (size_t)n * (2 * sizeof(double) + 4 * sizeof(int) + 1) + 2 * thread_count * sizeof(PrimOffer) + 8 * ARENA_ALIGN;
+}
+
+// Function to fill out[k - from] with the 1-tree cost of edge (i, k) for from <= k < to: the
+// cheaper direction of the pair, through min(d(i, k), d(k, i)), which no directed tour can beat
+static void boundRow(const DistanceTable *table, int i, int from, int to, int *out, int *column)
+{
+    distanceRow(table, i, from, to, out);
+    if (distanceSymmetric(table))
+        return;
+    distanceColumn(table, i, from, to, column);
+    for (int k = 0; k < to - from; k++)
+    {
+        out[k] = column[k] < out[k] ? column[k] : out[k];
+    }
+}
+
+void heldKarpInit(HeldKarpBound *hk, const DistanceTable *table, Arena *arena)
+{
+    int n = table->n;
+    hk->table = table;
+    hk->arena = arena;
+    hk->n = n;
+    hk->pi = arenaCalloc(arena, n * sizeof(double));
+    hk->key = arenaAlloc(arena, n * sizeof(double));
+    hk->parent = arenaAlloc(arena, n * sizeof(int));
+    hk->degree = arenaAlloc(arena, n * sizeof(int));
+    hk->in_tree = arenaAlloc(arena, n);
+    hk->row = arenaAlloc(arena, n * sizeof(int));
+    hk->column = arenaAlloc(arena, n * sizeof(int));
+    hk->best = n < 3 ? 0 : -DBL_MAX;
+    hk->lambda = HK_LAMBDA;
+    hk->stale = 0;
+    hk->iterations = 0;
+    hk->done = n < 3;
+}
+
+// One step is a minimum 1-tree on the penalised costs (Prim over cities 1 .. n - 1, then city
+// 0 joined by its two cheapest edges), then penalties moved towards degree 2 by a step sized
+// from the upper bound
+double heldKarpStep(HeldKarpBound *hk, double upper, int thread_count)
+{
+    if (hk->done)
+        return hk->best;
+
+    const DistanceTable *table = hk->table;
+    int n = hk->n;
+    double *pi = hk->pi, *key = hk->key;
+    int *parent = hk->parent, *degree = hk->degree, *row = hk->row, *column = hk->column;
+    char *in_tree = hk->in_tree;
+    double pi_sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        key[i] = DBL_MAX;
+        parent[i] = -1;
+        degree[i] = 0;
+        in_tree[i] = 0;
+        pi_sum += pi[i];
+    }
+    key[1] = 0;
+
+    // Parallel Prim on the penalised costs. Each thread owns a static block of cities, updates
+    // their keys from its block of the row of the city just added and offers its cheapest one;
+    // every thread then picks the same winner from the offers. Offers alternate between two
+    // rows, so one barrier per step keeps a fast thread from overwriting offers still being read
+    size_t mark = arenaMark(hk->arena);
+    PrimOffer *offers = arenaAlloc(hk->arena, 2 * thread_count * sizeof(PrimOffer));
+    double weight = 0;
+#pragma omp parallel num_threads(thread_count)
+    {
+        int tid = omp_get_thread_num();
+        int lo = 1 + (int)((long)(n - 1) * tid / thread_count), hi = 1 + (int)((long)(n - 1) * (tid + 1) / thread_count);
+        int u = -1;
+        for (int step = 1; step < n; step++)
+        {
+            int local_city = -1;
+
+            if (u >= 0)
+            {
+                boundRow(table, u, lo, hi, &row[lo], &column[lo]);
+            }
+            for (int v = lo; v < hi; v++)
+            {
+                if (v == u || in_tree[v])
+                    continue;
+                if (u >= 0)
+                {
+                    double cost = row[v] + pi[u] + pi[v];
+                    if (cost < key[v])
+                    {
+                        key[v] = cost;
+                        parent[v] = u;
+                    }
+                }
+                if (local_city < 0 || key[v] < key[local_city])
+                {
+                    local_city = v;
+                }
+            }
+
+            PrimOffer *row = &offers[(step & 1) * thread_count];
+            row[tid].city = local_city;
+            row[tid].key = local_city >= 0 ? key[local_city] : DBL_MAX;
+
+#pragma omp barrier
+
+            // Compare the offered keys, not key[]: the owners of the losing cities may
+            // already be updating them for the next step
+            u = -1;
+            double u_key = DBL_MAX;
+            for (int t = 0; t < thread_count; t++)
+            {
+                if (row[t].city >= 0 && (u < 0 || row[t].key < u_key || (row[t].key == u_key && row[t].city < u)))
+                {
+                    u = row[t].city;
+                    u_key = row[t].key;
+                }
+            }
+
+            if (tid == 0)
+            {
+                in_tree[u] = 1;
+                weight += u_key;
+                if (parent[u] >= 0)
+                {
+                    degree[u]++;
+                    degree[parent[u]]++;
+                }
+            }
+        }
+    }
+    arenaRelease(hk->arena, mark);
+
+    // Connect city 0 with its two cheapest edges
+    int first = -1, second = -1;
+    double first_cost = DBL_MAX, second_cost = DBL_MAX;
+    boundRow(table, 0, 0, n, row, column);
+    for (int v = 1; v < n; v++)
+    {
+        double cost = row[v] + pi[v];
+        if (cost < first_cost)
+        {
+            second = first;
+            second_cost = first_cost;
+            first = v;
+            first_cost = cost;
+        }
+        else if (cost < second_cost)
+        {
+            second = v;
+            second_cost = cost;
+        }
+    }
+    weight += first_cost + second_cost + 2 * pi[0] - 2 * pi_sum;
+    degree[0] = 2;
+    degree[first]++;
+    degree[second]++;
+
+    if (weight > hk->best + 1e-9)
+    {
+        hk->best = weight;
+        hk->stale = 0;
+    }
+    else if (++hk->stale >= HK_STALE)
+    {
+        hk->lambda /= 2;
+        hk->stale = 0;
+    }
+
+    double norm = 0;
+    for (int i = 0; i < n; i++)
+    {
+        norm += (double)(degree[i] - 2) * (degree[i] - 2);
+    }
+    hk->iterations++;
+    if (norm == 0 || hk->iterations >= HK_ITERATIONS)
+    {
+        // A 1-tree with every degree 2 is a tour, so its bound is exact
+        hk->done = 1;
+    }
+    else
+    {
+        double step = hk->lambda * (upper - weight) / norm;
+        for (int i = 0; i < n; i++)
+        {
+            pi[i] += step * (degree[i] - 2);
+        }
+    }
+
+    return hk->best;
+}
+
+long heldKarpValue(const HeldKarpBound *hk)
+{
+    return hk->best <= 0 ? 0 : (long)ceil(hk->best - 1e-6);
+}
+
+double heldKarpGap(const HeldKarpBound *hk, long cost)
+{
+    long bound = heldKarpValue(hk);
+    return bound > 0 ? 100.0 * (cost - bound) / bound : (cost > 0 ? 100.0 : 0.0);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file heldkarp.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Held-Karp lower bound for the TSP programs: minimum 1-trees on costs penalised per city,
+ * with the penalties moved towards degree 2 by subgradient steps. The solver takes one step
+ * between rounds and stops once its best tour is close enough to the bound; the benchmark runs
+ * it to the end to report every program's gap against the same bound. Build a program with
+ * it by adding heldkarp.c, distance.c and arena.c to its compile line.
+ */
+#ifndef HELDKARP_H
+#define HELDKARP_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "distance.h"
+
+// At most HK_ITERATIONS subgradient steps, starting from step factor HK_LAMBDA, halved after
+// HK_STALE steps without improvement
+#define HK_ITERATIONS 200
+#define HK_LAMBDA 2.0
+#define HK_STALE 10
+
+// State of the bound between subgradient steps. Asymmetric distances are bounded through
+// min(d(i, j), d(j, i)), which no directed tour can beat
+typedef struct
+{
+    const DistanceTable *table;
+    Arena *arena;  // holds the arrays below and each step's offers
+    int n;
+    double *pi;    // node penalties
+    double *key;   // Prim keys on the penalised costs
+    int *parent;
+    int *degree;
+    char *in_tree;
+    int *row;      // 1-tree costs from the city just added
+    int *column;   // and to it, when the table is asymmetric
+    double best;   // best bound so far
+    double lambda;
+    int stale;
+    int iterations;
+    int done;      // iteration limit reached, or the last 1-tree was a tour
+} HeldKarpBound;
+
+// Arena bytes the bound of an n city table takes, steps on thread_count threads included
+size_t heldKarpBytes(int n, int thread_count);
+
+// Set up the bound with zero penalties, taking its arrays from the arena
+void heldKarpInit(HeldKarpBound *hk, const DistanceTable *table, Arena *arena);
+
+// Run one subgradient step with upper as the best known tour cost, Prim's loop on
+// thread_count threads. Returns the best bound so far
+double heldKarpStep(HeldKarpBound *hk, double upper, int thread_count);
+
+// The bound rounded up to the integer cost every tour must reach
+long heldKarpValue(const HeldKarpBound *hk);
+
+// The gap between a tour cost and the bound in percent of the bound
+double heldKarpGap(const HeldKarpBound *hk, long cost);
+
+#endif
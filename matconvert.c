@@ -0,0 +1,208 @@
+/**
+ * @file matconvert.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Compile:  gcc -Wall -g -O3 -march=native -o matconvert.o matconvert.c matfile.c -fopenmp -std=c99 -lm
+ * Usage: ./matconvert.o [-l row|col|tiled] [-t tile] [-c chunk KiB] [-d f64|f32] <input.bin> <output.dm2>
+ *        ./matconvert.o -v <file.dm2>
+ *        Converts a raw row-major .bin matrix of doubles (square, size taken from the file length)
+ *        to a version 2 file, see matfile.h. The default is row major float64 in 1 MiB chunks,
+ *        which parallelmatrix -i v2 reads as input-matrix/mNNNNxNNNN.dm2. -v reads a file back
+ *        with parallel preads and checks every chunk CRC. Convert the whole input set by running it
+ *        on each input-matrix .bin file with the same name ending in .dm2
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "matfile.h"
+
+// Function headers
+int convert(const char *in, const char *out, MatLayout layout, uint32_t tile, uint64_t chunk, MatDtype dtype);
+int verify(const char *path);
+
+int main(int argc, char *argv[])
+{
+    MatLayout layout = MAT_ROW_MAJOR;
+    MatDtype dtype = MAT_F64;
+    uint32_t tile = 64;
+    uint64_t chunk = MATFILE_CHUNK;
+    const char *files[2];
+    int nfiles = 0;
+    int check = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "row") == 0)
+            {
+                layout = MAT_ROW_MAJOR;
+            }
+            else if (strcmp(argv[i], "col") == 0)
+            {
+                layout = MAT_COL_MAJOR;
+            }
+            else if (strcmp(argv[i], "tiled") == 0)
+            {
+                layout = MAT_TILED;
+            }
+            else
+            {
+                printf("Unknown layout %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            tile = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            chunk = strtoull(argv[++i], NULL, 10) * 1024;
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "f64") == 0)
+            {
+                dtype = MAT_F64;
+            }
+            else if (strcmp(argv[i], "f32") == 0)
+            {
+                dtype = MAT_F32;
+            }
+            else
+            {
+                printf("Unknown type %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            check = 1;
+        }
+        else if (argv[i][0] != '-' && nfiles < 2)
+        {
+            files[nfiles++] = argv[i];
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (check && nfiles == 1)
+    {
+        return verify(files[0]);
+    }
+    if (check || nfiles != 2 || tile == 0 || chunk == 0)
+    {
+        printf("Usage: %s [-l row|col|tiled] [-t tile] [-c chunk KiB] [-d f64|f32] <input.bin> <output.dm2>\n"
+               "       %s -v <file.dm2>\n", argv[0], argv[0]);
+        return 1;
+    }
+    return convert(files[0], files[1], layout, tile, chunk, dtype);
+}
+
+// Function to convert one .bin file, then read the result back to check it round trips
+int convert(const char *in, const char *out, MatLayout layout, uint32_t tile, uint64_t chunk, MatDtype dtype)
+{
+    struct stat st;
+    if (stat(in, &st) != 0)
+    {
+        printf("Error opening %s.\n", in);
+        return 1;
+    }
+    uint64_t n = (uint64_t)sqrt((double)st.st_size / sizeof(double) + 0.5);
+    if (n == 0 || n * n * sizeof(double) != (uint64_t)st.st_size)
+    {
+        printf("%s is not a square matrix of doubles.\n", in);
+        return 1;
+    }
+
+    double *src = malloc(st.st_size);
+    FILE *datafile = fopen(in, "rb");
+    if (datafile == NULL || fread(src, sizeof(double), n * n, datafile) != n * n)
+    {
+        printf("Error reading %s.\n", in);
+        return 1;
+    }
+    fclose(datafile);
+
+    MatHeader h;
+    matHeaderInit(&h, n, n, dtype, layout, tile, chunk);
+    void *packed = malloc(h.data_bytes + 1);
+    matPack(&h, src, packed);
+
+    double start = omp_get_wtime();
+    if (matWrite(out, &h, packed) != 0)
+    {
+        printf("Error writing %s.\n", out);
+        return 1;
+    }
+    printf("Wrote %s: %llux%llu, %llu chunks of %llu KiB in %fs\n", out, (unsigned long long)n, (unsigned long long)n,
+           (unsigned long long)h.chunks, (unsigned long long)h.chunk_bytes / 1024, omp_get_wtime() - start);
+    free(packed);
+
+    // Every element must come back as written (to float precision for f32)
+    MatHeader back;
+    int bad_chunks;
+    void *data = matRead(out, &back, &bad_chunks);
+    if (data == NULL || bad_chunks > 0)
+    {
+        printf("Error reading back %s.\n", out);
+        return 1;
+    }
+    double *row = malloc(n * sizeof(double));
+    uint64_t mismatches = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        matGetRow(&back, data, i, row);
+        for (uint64_t j = 0; j < n; j++)
+        {
+            double expect = dtype == MAT_F32 ? (double)(float)src[i * n + j] : src[i * n + j];
+            mismatches += row[j] != expect;
+        }
+    }
+    free(row);
+    free(data);
+    free(src);
+    if (mismatches > 0)
+    {
+        printf("%llu elements of %s do not match %s.\n", (unsigned long long)mismatches, out, in);
+        return 1;
+    }
+    return 0;
+}
+
+// Function to read a version 2 file and report its header and chunk checks
+int verify(const char *path)
+{
+    MatHeader h;
+    int bad_chunks;
+    double start = omp_get_wtime();
+    void *data = matRead(path, &h, &bad_chunks);
+    double end = omp_get_wtime();
+    if (data == NULL)
+    {
+        printf("Error reading %s: missing file or bad header.\n", path);
+        return 1;
+    }
+    free(data);
+    printf("%s: %llux%llu %s, %s", path, (unsigned long long)h.rows, (unsigned long long)h.cols,
+           h.dtype == MAT_F32 ? "float32" : "float64",
+           h.layout == MAT_TILED ? "tiled" : h.layout == MAT_COL_MAJOR ? "column major" : "row major");
+    if (h.layout == MAT_TILED)
+    {
+        printf(" %u", h.tile);
+    }
+    printf(", %llu chunks, %d bad, read in %fs (%.2f GB/s)\n", (unsigned long long)h.chunks, bad_chunks,
+           end - start, h.data_bytes / (end - start) * 1e-9);
+    return bad_chunks > 0;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file matfile.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Version 2 matrix files, see matfile.h. CRC32C uses the SSE4.2 crc32 instruction when the
+ * compiler targets it (-msse4.2 or -march=native) and a lookup table otherwise.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include "matfile.h"
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#else
+static uint32_t crc_table[256];
+static int crc_table_ready = 0;
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t bytes)
+{
+    const unsigned char *p = data;
+    crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    while (bytes >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+        p += 8;
+        bytes -= 8;
+    }
+    while (bytes-- > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+#else
+    if (!crc_table_ready)
+    {
+#pragma omp critical(matfile_crc_table)
+        if (!crc_table_ready)
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+                }
+                crc_table[i] = c;
+            }
+#pragma omp flush
+            crc_table_ready = 1;
+        }
+    }
+    while (bytes-- > 0)
+    {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+#endif
+    return ~crc;
+}
+
+size_t matElementSize(const MatHeader *h)
+{
+    return h->dtype == MAT_F32 ? sizeof(float) : sizeof(double);
+}
+
+void matHeaderInit(MatHeader *h, uint64_t rows, uint64_t cols, MatDtype dtype, MatLayout layout, uint32_t tile, uint64_t chunk_bytes)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATFILE_MAGIC, sizeof(MATFILE_MAGIC));
+    h->version = MATFILE_VERSION;
+    h->dtype = dtype;
+    h->rows = rows;
+    h->cols = cols;
+    h->layout = layout;
+    h->tile = layout == MAT_TILED ? tile : 0;
+    h->chunk_bytes = (chunk_bytes + MATFILE_PAGE - 1) / MATFILE_PAGE * MATFILE_PAGE;
+
+    uint64_t elements = rows * cols;
+    if (layout == MAT_TILED)
+    {
+        elements = (rows + tile - 1) / tile * ((cols + tile - 1) / tile) * tile * tile;
+    }
+    h->data_bytes = elements * matElementSize(h);
+    h->chunks = (h->data_bytes + h->chunk_bytes - 1) / h->chunk_bytes;
+    uint64_t table_end = MATFILE_PAGE + h->chunks * sizeof(uint32_t);
+    h->data_offset = (table_end + MATFILE_PAGE - 1) / MATFILE_PAGE * MATFILE_PAGE;
+}
+
+uint64_t matIndex(const MatHeader *h, uint64_t i, uint64_t j)
+{
+    switch (h->layout)
+    {
+    case MAT_COL_MAJOR:
+        return j * h->rows + i;
+    case MAT_TILED:
+    {
+        uint64_t t = h->tile;
+        uint64_t tiles_across = (h->cols + t - 1) / t;
+        return ((i / t) * tiles_across + j / t) * t * t + (i % t) * t + j % t;
+    }
+    default:
+        return i * h->cols + j;
+    }
+}
+
+void matPack(const MatHeader *h, const double *src, void *out)
+{
+    memset(out, 0, h->data_bytes);
+#pragma omp parallel for schedule(static)
+    for (uint64_t i = 0; i < h->rows; i++)
+    {
+        for (uint64_t j = 0; j < h->cols; j++)
+        {
+            uint64_t k = matIndex(h, i, j);
+            double v = src[i * h->cols + j];
+            if (h->dtype == MAT_F32)
+                ((float *)out)[k] = (float)v;
+            else
+                ((double *)out)[k] = v;
+        }
+    }
+}
+
+void matGetRow(const MatHeader *h, const void *data, uint64_t i, double *row)
+{
+    if (h->layout == MAT_ROW_MAJOR && h->dtype == MAT_F64)
+    {
+        memcpy(row, (const double *)data + i * h->cols, h->cols * sizeof(double));
+        return;
+    }
+    for (uint64_t j = 0; j < h->cols; j++)
+    {
+        uint64_t k = matIndex(h, i, j);
+        row[j] = h->dtype == MAT_F32 ? ((const float *)data)[k] : ((const double *)data)[k];
+    }
+}
+
+// Function to checksum the header (with its CRC field cleared) followed by the chunk table
+static uint32_t headerCrc(const MatHeader *h, const uint32_t *table)
+{
+    MatHeader copy = *h;
+    copy.header_crc = 0;
+    uint32_t crc = crc32c(0, &copy, sizeof(copy));
+    return crc32c(crc, table, h->chunks * sizeof(uint32_t));
+}
+
+int matWrite(const char *path, MatHeader *h, const void *data)
+{
+    uint32_t *table = malloc(h->chunks * sizeof(uint32_t));
+#pragma omp parallel for schedule(dynamic)
+    for (uint64_t c = 0; c < h->chunks; c++)
+    {
+        uint64_t start = c * h->chunk_bytes;
+        uint64_t bytes = h->data_bytes - start < h->chunk_bytes ? h->data_bytes - start : h->chunk_bytes;
+        table[c] = crc32c(0, (const char *)data + start, bytes);
+    }
+    h->header_crc = headerCrc(h, table);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        free(table);
+        return -1;
+    }
+    char *page = calloc(1, MATFILE_PAGE);
+    memcpy(page, h, sizeof(*h));
+    size_t table_bytes = h->chunks * sizeof(uint32_t);
+    int failed = pwrite(fd, page, MATFILE_PAGE, 0) != MATFILE_PAGE ||
+                 pwrite(fd, table, table_bytes, MATFILE_PAGE) != (ssize_t)table_bytes;
+
+    // Chunks are written in parallel too, each at its own offset
+#pragma omp parallel for schedule(dynamic) reduction(| : failed)
+    for (uint64_t c = 0; c < h->chunks; c++)
+    {
+        uint64_t start = c * h->chunk_bytes;
+        uint64_t bytes = h->data_bytes - start < h->chunk_bytes ? h->data_bytes - start : h->chunk_bytes;
+        if (pwrite(fd, (const char *)data + start, bytes, h->data_offset + start) != (ssize_t)bytes)
+            failed = 1;
+    }
+    failed |= close(fd) != 0;
+    free(page);
+    free(table);
+    return failed ? -1 : 0;
+}
+
+// Function to open a file and check its header and chunk table. Returns the descriptor, or -1
+static int openChecked(const char *path, MatHeader *h, uint32_t **table)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (pread(fd, h, sizeof(*h), 0) != sizeof(*h) || memcmp(h->magic, MATFILE_MAGIC, sizeof(MATFILE_MAGIC)) != 0 ||
+        h->version != MATFILE_VERSION || h->chunk_bytes == 0 || h->chunk_bytes % MATFILE_PAGE != 0 ||
+        h->chunks != (h->data_bytes + h->chunk_bytes - 1) / h->chunk_bytes)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t table_bytes = h->chunks * sizeof(uint32_t);
+    *table = malloc(table_bytes);
+    if (pread(fd, *table, table_bytes, MATFILE_PAGE) != (ssize_t)table_bytes || headerCrc(h, *table) != h->header_crc)
+    {
+        free(*table);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to read every chunk into place in parallel, returns the number that failed their CRC
+static int readChunks(int fd, const MatHeader *h, const uint32_t *table, void *data)
+{
+    int bad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : bad)
+    for (uint64_t c = 0; c < h->chunks; c++)
+    {
+        uint64_t start = c * h->chunk_bytes;
+        uint64_t bytes = h->data_bytes - start < h->chunk_bytes ? h->data_bytes - start : h->chunk_bytes;
+        char *dst = (char *)data + start;
+        uint64_t done = 0;
+        while (done < bytes)
+        {
+            ssize_t got = pread(fd, dst + done, bytes - done, h->data_offset + start + done);
+            if (got <= 0)
+                break;
+            done += got;
+        }
+        if (done != bytes || crc32c(0, dst, bytes) != table[c])
+            bad++;
+    }
+    return bad;
+}
+
+int matReadHeader(const char *path, MatHeader *h)
+{
+    uint32_t *table;
+    int fd = openChecked(path, h, &table);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    free(table);
+    close(fd);
+    return 0;
+}
+
+int matReadInto(const char *path, MatHeader *h, void *data, size_t capacity, int *bad_chunks)
+{
+    *bad_chunks = 0;
+    uint32_t *table;
+    int fd = openChecked(path, h, &table);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (h->data_bytes > capacity)
+    {
+        free(table);
+        close(fd);
+        return -1;
+    }
+    *bad_chunks = readChunks(fd, h, table, data);
+    free(table);
+    close(fd);
+    return 0;
+}
+
+void *matRead(const char *path, MatHeader *h, int *bad_chunks)
+{
+    *bad_chunks = 0;
+    uint32_t *table;
+    void *data = NULL;
+    int fd = openChecked(path, h, &table);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (posix_memalign(&data, MATFILE_PAGE, (h->data_bytes + MATFILE_PAGE - 1) / MATFILE_PAGE * MATFILE_PAGE) != 0)
+    {
+        free(table);
+        close(fd);
+        return NULL;
+    }
+    *bad_chunks = readChunks(fd, h, table, data);
+    free(table);
+    close(fd);
+    return data;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file matfile.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Version 2 matrix files. A page of header describes the matrix (dimensions, element type,
+ * row major, column major or square tiles) and is followed by a CRC32C for every chunk of
+ * the data. The data starts on a page boundary and is cut into chunks of whole pages, so
+ * each chunk can be read on its own with pread straight into its place in memory and
+ * checked independently. Build a program with it by adding matfile.c to its compile line.
+ */
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MATFILE_MAGIC "DETMAT2"
+#define MATFILE_VERSION 2
+#define MATFILE_PAGE 4096
+// Default chunk size, a multiple of MATFILE_PAGE
+#define MATFILE_CHUNK (1 << 20)
+
+typedef enum
+{
+    MAT_F64 = 1,
+    MAT_F32 = 2
+} MatDtype;
+
+// Element order of the data. Tiled stores tile x tile blocks row by row, each block row
+// major; blocks on the right and bottom edges are padded with zeros to a whole tile
+typedef enum
+{
+    MAT_ROW_MAJOR = 0,
+    MAT_COL_MAJOR = 1,
+    MAT_TILED = 2
+} MatLayout;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t rows;
+    uint64_t cols;
+    uint32_t layout;
+    uint32_t tile;
+    uint64_t chunk_bytes;
+    uint64_t chunks;
+    uint64_t data_bytes;  // bytes of elements, tile padding included
+    uint64_t data_offset; // page aligned, after the header page and the chunk CRC table
+    uint32_t header_crc;  // CRC32C of this header (with header_crc zero) then the chunk table
+    uint32_t reserved;
+} MatHeader;
+
+// CRC32C (Castagnoli) continued from crc over bytes; start from 0
+uint32_t crc32c(uint32_t crc, const void *data, size_t bytes);
+
+// Fill in the derived fields (sizes, chunk count, data offset) of a header for a matrix
+void matHeaderInit(MatHeader *h, uint64_t rows, uint64_t cols, MatDtype dtype, MatLayout layout, uint32_t tile, uint64_t chunk_bytes);
+
+size_t matElementSize(const MatHeader *h);
+
+// Position of element (i, j) in the data, counted in elements
+uint64_t matIndex(const MatHeader *h, uint64_t i, uint64_t j);
+
+// Store a row-major double matrix in the layout and type of the header, into data_bytes at out
+void matPack(const MatHeader *h, const double *src, void *out);
+
+// Copy row i of the data out as doubles
+void matGetRow(const MatHeader *h, const void *data, uint64_t i, double *row);
+
+// Write the header, chunk CRCs and packed data; returns 0 on success
+int matWrite(const char *path, MatHeader *h, const void *data);
+
+// Read a file with parallel preads, one chunk per read, checking every CRC. Returns a page
+// aligned buffer of h->data_bytes (free with free) or NULL when the file cannot be read or
+// its header is damaged; *bad_chunks counts chunks whose CRC did not match
+void *matRead(const char *path, MatHeader *h, int *bad_chunks);
+
+// Read and check only the header; returns 0 on success
+int matReadHeader(const char *path, MatHeader *h);
+
+// As matRead, into a caller's buffer of capacity bytes; returns -1 when the file cannot be
+// read, its header is damaged or its data does not fit
+int matReadInto(const char *path, MatHeader *h, void *data, size_t capacity, int *bad_chunks);
+
+#endif
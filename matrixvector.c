@@ -2,8 +2,11 @@
  * @file matrixvector.c
  * @authors Camp Steiner, Jeff Luong
  *
- * Compile:  gcc -Wall -g -o matrixvector.o matrixvector.c -fopenmp -std=c99 -lm
- * Usage: ./matrixvector.o
+ * Compile:  gcc -Wall -g -O3 -march=native -o matrixvector.o matrixvector.c -fopenmp -std=c99 -lm
+ * Usage: ./matrixvector.o [-v vectors per batch] [-s seconds per measurement]
+ *        y = A x over the matrices in input-matrix on OMP_NUM_THREADS threads. Each size reports the
+ *        single and batched GEMV bandwidth against the STREAM triad bandwidth of the machine; sizes
+ *        whose matrix fits in cache can run faster than STREAM
  */
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,9 +16,21 @@
 #include <math.h>
 #include <stdbool.h>
 
+// Doubles per STREAM array (three arrays of 64 MB), and repetitions of the triad
+#define STREAM_DOUBLES (1 << 23)
+#define STREAM_REPEAT 5
+
+// Batched GEMV tiles: GEMV_ROWS rows of A at a time (the kernel is written out for 4),
+// GEMV_COLS columns of A and of every x
+#define GEMV_ROWS 4
+#define GEMV_COLS 512
+
 // Function headers
-long double PLUDeterminantSerial(double **a, int n, bool lt);
-long double PLUDeterminantOMP(double **a, int n, bool lt);
+double streamTriad(void);
+void gemv(double **a, int n, const double *x, double *y);
+void gemvBatched(double **a, int n, const double *x, double *y, int nv);
+void gemvReference(double **a, int n, const double *x, double *y);
+double timeGemv(double **a, int n, const double *x, double *y, int nv, double seconds);
 
 int main(int argc, char *argv[])
 {
@@ -23,219 +38,261 @@ int main(int argc, char *argv[])
 
     int sizes[] = {16, 32, 64, 128, 256, 496, 512, 1000, 1024, 2000, 2048, 3000, 4000, 4096};
 
-    printf("===SERIAL RUN===\n\n");
+    int nv = 16;
+    double seconds = 0.2;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+        {
+            nv = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seconds = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+    if (nv < 1)
+    {
+        printf("Need at least one vector per batch.\n");
+        return 1;
+    }
+
+    double peak = streamTriad();
+    printf("===GEMV RUN - %d THREADS, STREAM TRIAD %.2f GB/s===\n", omp_get_max_threads(), peak);
 
     for (int i = 0; i < 14; i++)
     {
         int arraySize = sizes[i];
 
-        double **a = malloc(arraySize * sizeof(double));
         // Create filename
         sprintf(f_name, "input-matrix/m%04dx%04d.bin", arraySize, arraySize);
-        // sprintf(f_name, "input-matrix/m0256x0256.bin");
         printf("\n(1) Reading array file %s\n", f_name);
         printf("(2) Size %dx%d\n", arraySize, arraySize);
         // Open file
         FILE *datafile = fopen(f_name, "rb");
-        // Read elelements
+        if (datafile == NULL)
+        {
+            printf("Error opening %s.\n", f_name);
+            continue;
+        }
+        // Rows point into one block, read and first touched by the threads that use them
+        double **a = malloc(arraySize * sizeof(double *));
+        a[0] = malloc((size_t)arraySize * arraySize * sizeof(double));
+        for (int i = 1; i < arraySize; i++)
+        {
+            a[i] = a[0] + (size_t)i * arraySize;
+        }
+        #pragma omp parallel for schedule(static)
         for (int i = 0; i < arraySize; i++)
         {
-            a[i] = (double *)malloc(arraySize * sizeof(double));
-            for (int j = 0; j < arraySize; j++)
+            memset(a[i], 0, arraySize * sizeof(double));
+        }
+        if (fread(a[0], sizeof(double), (size_t)arraySize * arraySize, datafile) != (size_t)arraySize * arraySize)
+        {
+            printf("Error reading %s.\n", f_name);
+            fclose(datafile);
+            free(a[0]);
+            free(a);
+            continue;
+        }
+        fclose(datafile);
+
+        double *x = malloc((size_t)arraySize * nv * sizeof(double));
+        double *y = malloc((size_t)arraySize * nv * sizeof(double));
+        double *expect = malloc((size_t)arraySize * sizeof(double));
+        for (size_t k = 0; k < (size_t)arraySize * nv; k++)
+        {
+            x[k] = sin(0.001 * k + 1.0);
+        }
+
+        // Check both kernels against the plain loop on the first and last vector of the batch
+        double error = 0;
+        gemv(a, arraySize, x, y);
+        gemvReference(a, arraySize, x, expect);
+        for (int k = 0; k < arraySize; k++)
+        {
+            error = fmax(error, fabs(y[k] - expect[k]) / (1.0 + fabs(expect[k])));
+        }
+        gemvBatched(a, arraySize, x, y, nv);
+        for (int v = 0; v < nv; v += nv - 1 > 0 ? nv - 1 : 1)
+        {
+            gemvReference(a, arraySize, x + (size_t)v * arraySize, expect);
+            for (int k = 0; k < arraySize; k++)
             {
-                fread(&a[i][j], sizeof(double), 1, datafile);
-                // printf("%f,", a[i][j]);
+                error = fmax(error, fabs(y[(size_t)v * arraySize + k] - expect[k]) / (1.0 + fabs(expect[k])));
             }
-            // printf("\n");
         }
-        // printf("Matrix has been read.\n");
-        fclose(datafile);
 
-        double start, end;
-
-        start = omp_get_wtime();
-        long double det = PLUDeterminantSerial(a, arraySize, false);
-        end = omp_get_wtime();
-        printf("(3) Determinant: %.6Le in %fs\n", det, (end - start));
-
-        start = omp_get_wtime();
-        long double det10 = PLUDeterminantSerial(a, arraySize, true);
-        end = omp_get_wtime();
-        printf("(4) Log10 Determinant: %.6Le in %fs\n", det10, (end - start));
-
-        // FILE *f = fopen("out.csv", "w");
-        // if (f == NULL)
-        // {
-        //     printf("Error opening file!\n");
-        //     exit(1);
-        // }
-
-        // // loop over the values in the matrix
-        // for (int i = 0; i < arraySize; i++)
-        // {
-        //     for (int j = 0; j < arraySize; j++)
-        //     {
-        //         fprintf(f, "%lf,", a[i][j]);
-        //     }
-        //     fprintf(f, "\n");
-        // }
-
-        // // close the file
-        // fclose(f);
+        // Bytes moved: A once per call plus the vectors read and written
+        double matrix_bytes = (double)arraySize * arraySize * sizeof(double);
+        double single = timeGemv(a, arraySize, x, y, 1, seconds);
+        double single_gbs = (matrix_bytes + 2.0 * arraySize * sizeof(double)) / single * 1e-9;
+        printf("(3) GEMV: %.6fs, %.2f GB/s (%.0f%% of STREAM), %.2f GFLOP/s\n",
+               single, single_gbs, 100 * single_gbs / peak, 2.0 * arraySize * arraySize / single * 1e-9);
+
+        double batched = timeGemv(a, arraySize, x, y, nv, seconds);
+        double batched_gbs = (matrix_bytes + 2.0 * arraySize * nv * sizeof(double)) / batched * 1e-9;
+        printf("(4) Batched GEMV, %d vectors: %.6fs (%.6fs per vector), %.2f GB/s (%.0f%% of STREAM), %.2f GFLOP/s\n",
+               nv, batched, batched / nv, batched_gbs, 100 * batched_gbs / peak, 2.0 * arraySize * arraySize * nv / batched * 1e-9);
+        printf("(5) Max relative error against the plain loop: %.2e\n", error);
+
+        free(x);
+        free(y);
+        free(expect);
+        free(a[0]);
+        free(a);
     }
 
     return 0;
 }
 
-long double PLUDeterminantSerial(double **arr, int n, bool lt)
+// STREAM triad a = b + s * c on all threads, returns the best bandwidth in GB/s
+double streamTriad(void)
 {
-    // Copy array into local variable so arr doesn't get modified
-    int nswaps = 0;
-    double **a = malloc(n * sizeof(double));
-    for (int i = 0; i < n; i++)
+    double *a = malloc(STREAM_DOUBLES * sizeof(double));
+    double *b = malloc(STREAM_DOUBLES * sizeof(double));
+    double *c = malloc(STREAM_DOUBLES * sizeof(double));
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < STREAM_DOUBLES; i++)
     {
-        a[i] = (double *)malloc(n * sizeof(double));
-        memcpy(a[i], arr[i], n * sizeof(double));
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
     }
-    // perform PLU decomposition
-    for (int k = 0; k < n; k++)
-    {
-        // pivot
-        int i_max = k;
-        for (int i = k; i < n; i++)
-        {
-            if (fabs(a[i][k]) > fabs(a[i_max][k]))
-            {
-                i_max = i;
-            }
-        }
-        if (i_max != k)
-        {
-            for (int j = 0; j < n; j++)
-            {
-                double temp = a[k][j];
-                a[k][j] = a[i_max][j];
-                a[i_max][j] = temp;
-            }
-            nswaps++;
-        }
 
-        // elimination
-        for (int i = k + 1; i < n; i++)
+    double best = 1e30;
+    for (int r = 0; r < STREAM_REPEAT; r++)
+    {
+        double start = omp_get_wtime();
+        #pragma omp parallel for simd schedule(static)
+        for (long i = 0; i < STREAM_DOUBLES; i++)
         {
-            double factor = a[i][k] / a[k][k];
-            for (int j = k; j < n; j++)
-            {
-                a[i][j] -= factor * a[k][j];
-            }
-            a[i][k] = factor;
+            a[i] = b[i] + 3.0 * c[i];
         }
+        double t = omp_get_wtime() - start;
+        best = t < best ? t : best;
     }
+    // Keep the result live
+    if (a[STREAM_DOUBLES / 2] != 7.0)
+    {
+        printf("STREAM triad check failed.\n");
+    }
+    free(a);
+    free(b);
+    free(c);
+    return 3.0 * sizeof(double) * STREAM_DOUBLES / best * 1e-9;
+}
 
-    // print the result
-    // for (int i = 0; i < n; i++)
-    // {
-    //     for (int j = 0; j < n; j++)
-    //     {
-    //         printf("%lf,", a[i][j]);
-    //     }
-    //     printf("\n");
-    // }
-
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
+// y = A x, rows shared out in static blocks, each row a SIMD dot product
+void gemv(double **a, int n, const double *x, double *y)
+{
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < n; i++)
     {
-        if (lt)
+        const double *row = a[i];
+        double sum = 0;
+        #pragma omp simd reduction(+ : sum)
+        for (int j = 0; j < n; j++)
         {
-            det *= log10(fabs(a[i][i]));
-        }
-        else
-        {
-            det *= a[i][i];
+            sum += row[j] * x[j];
         }
+        y[i] = sum;
     }
-
-    if (!lt && nswaps % 2 != 0)
-    { // parity for permutations I think?
-        det *= -1;
-    }
-    return det;
 }
 
-long double PLUDeterminantOMP(double **arr, int n, bool lt)
+// y_v = A x_v for nv vectors stored one after another. A is read once: every GEMV_ROWS x
+// GEMV_COLS tile of A is applied to the matching GEMV_COLS slice of every vector while it
+// is in cache, so the batch costs about one pass over A instead of nv
+void gemvBatched(double **a, int n, const double *x, double *y, int nv)
 {
-    // Copy array into local variable so arr doesn't get modified
-    int nswaps = 0;
-    double **a = malloc(n * sizeof(double));
-    for (int i = 0; i < n; i++)
-    {
-        a[i] = (double *)malloc(n * sizeof(double));
-        memcpy(a[i], arr[i], n * sizeof(double));
-    }
-    // perform PLU decomposition
-    for (int k = 0; k < n; k++)
+    #pragma omp parallel
     {
-        // pivot
-        int i_max = k;
-        for (int i = k; i < n; i++)
+        double *acc = malloc((size_t)GEMV_ROWS * nv * sizeof(double));
+
+        #pragma omp for schedule(static)
+        for (int i0 = 0; i0 < n; i0 += GEMV_ROWS)
         {
-            if (fabs(a[i][k]) > fabs(a[i_max][k]))
+            int rows = n - i0 < GEMV_ROWS ? n - i0 : GEMV_ROWS;
+            memset(acc, 0, (size_t)GEMV_ROWS * nv * sizeof(double));
+
+            // Missing rows of the last block repeat the first row and are not stored
+            const double *r0 = a[i0];
+            const double *r1 = a[i0 + (rows > 1 ? 1 : 0)];
+            const double *r2 = a[i0 + (rows > 2 ? 2 : 0)];
+            const double *r3 = a[i0 + (rows > 3 ? 3 : 0)];
+            for (int j0 = 0; j0 < n; j0 += GEMV_COLS)
             {
-                i_max = i;
+                int j1 = n - j0 < GEMV_COLS ? n : j0 + GEMV_COLS;
+                for (int v = 0; v < nv; v++)
+                {
+                    const double *xv = x + (size_t)v * n;
+                    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                    #pragma omp simd reduction(+ : s0, s1, s2, s3)
+                    for (int j = j0; j < j1; j++)
+                    {
+                        s0 += r0[j] * xv[j];
+                        s1 += r1[j] * xv[j];
+                        s2 += r2[j] * xv[j];
+                        s3 += r3[j] * xv[j];
+                    }
+                    acc[0 * nv + v] += s0;
+                    acc[1 * nv + v] += s1;
+                    acc[2 * nv + v] += s2;
+                    acc[3 * nv + v] += s3;
+                }
             }
-        }
-        if (i_max != k)
-        {
-            for (int j = 0; j < n; j++)
+
+            for (int r = 0; r < rows; r++)
             {
-                double temp = a[k][j];
-                a[k][j] = a[i_max][j];
-                a[i_max][j] = temp;
+                for (int v = 0; v < nv; v++)
+                {
+                    y[(size_t)v * n + i0 + r] = acc[r * nv + v];
+                }
             }
-            nswaps++;
         }
+        free(acc);
+    }
+}
 
-// elimination
-#pragma omp parallel for
-        for (int i = k + 1; i < n; i++)
+// y = A x with plain loops, used to check the other kernels
+void gemvReference(double **a, int n, const double *x, double *y)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double sum = 0;
+        for (int j = 0; j < n; j++)
         {
-            double factor = a[i][k] / a[k][k];
-            for (int j = k; j < n; j++)
-            {
-                a[i][j] -= factor * a[k][j];
-            }
-            a[i][k] = factor;
+            sum += a[i][j] * x[j];
         }
+        y[i] = sum;
     }
+}
 
-    // print the result
-    // for (int i = 0; i < n; i++)
-    // {
-    //     for (int j = 0; j < n; j++)
-    //     {
-    //         printf("%lf,", a[i][j]);
-    //     }
-    //     printf("\n");
-    // }
-
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
-    for (int i = 0; i < n; i++)
+// Function to time one call of the single (nv == 1) or batched kernel, best of as many calls
+// as fit in the given number of seconds
+double timeGemv(double **a, int n, const double *x, double *y, int nv, double seconds)
+{
+    double best = 1e30;
+    double begin = omp_get_wtime();
+    do
     {
-        if (lt)
+        double start = omp_get_wtime();
+        if (nv == 1)
         {
-            det *= log10(fabs(a[i][i]));
+            gemv(a, n, x, y);
         }
         else
         {
-            det *= a[i][i];
+            gemvBatched(a, n, x, y, nv);
         }
-    }
-
-    if (!lt && nswaps % 2 != 0)
-    { // parity for permutations I think?
-        det *= -1;
-    }
-    return det;
-}
\ No newline at end of file
+        double t = omp_get_wtime() - start;
+        best = t < best ? t : best;
+    } while (omp_get_wtime() - begin < seconds);
+    return best;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file matstream.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Load/compute pipeline for the determinant sweeps, see matstream.h.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+#include "matfile.h"
+#include "matstream.h"
+
+// Read a whole range with pread, retrying short reads
+int preadFull(int fd, void *buf, size_t bytes, off_t offset)
+{
+    char *p = buf;
+    while (bytes > 0)
+    {
+        ssize_t got = pread(fd, p, bytes, offset);
+        if (got <= 0)
+        {
+            return -1;
+        }
+        p += got;
+        bytes -= got;
+        offset += got;
+    }
+    return 0;
+}
+
+// Create the name of the input file for an n x n matrix
+void matrixPath(char *f_name, int n, bool v2)
+{
+    sprintf(f_name, v2 ? "input-matrix/m%04dx%04d.dm2" : "input-matrix/m%04dx%04d.bin", n, n);
+}
+
+int matrixLargest(const int *sizes, int count, bool v2)
+{
+    int max_n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int n = sizes[i];
+        char f_name[50];
+        if (n <= max_n)
+            continue;
+        matrixPath(f_name, n, v2);
+        if (v2)
+        {
+            MatHeader header;
+            if (matReadHeader(f_name, &header) == 0 && header.rows == (uint64_t)n && header.cols == (uint64_t)n)
+                max_n = n;
+        }
+        else
+        {
+            struct stat st;
+            if (stat(f_name, &st) == 0 && (size_t)st.st_size >= (size_t)n * n * sizeof(double))
+                max_n = n;
+        }
+    }
+    return max_n;
+}
+
+// Allocate the ring once for the largest matrix. Pages are first touched in static blocks by
+// the whole team so they are spread over the nodes the factorization runs on
+void matrixStreamInit(MatrixStream *s, int max_n)
+{
+    s->capacity = (size_t)max_n * max_n;
+    for (int k = 0; k < MATRIX_SLOTS; k++)
+    {
+        MatrixSlot *slot = &s->slots[k];
+        slot->rows = malloc(max_n * sizeof(double *));
+        if (posix_memalign((void **)&slot->data, MATFILE_PAGE, s->capacity * sizeof(double)) != 0)
+        {
+            printf("Error allocating %d matrix buffers of %dx%d.\n", MATRIX_SLOTS, max_n, max_n);
+            exit(1);
+        }
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < max_n; i++)
+        {
+            memset(slot->data + (size_t)i * max_n, 0, max_n * sizeof(double));
+        }
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+}
+
+// Function to read matrix k of the sweep into its slot, on the reader thread
+static void matrixLoad(MatrixStream *s, long k)
+{
+    int n = s->sizes[k];
+    MatrixSlot *slot = &s->slots[k % MATRIX_SLOTS];
+    char f_name[50];
+    matrixPath(f_name, n, s->v2);
+    double start = omp_get_wtime();
+
+    slot->ok = false;
+    if ((size_t)n * n > s->capacity)
+    {
+        return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        slot->rows[i] = slot->data + (size_t)i * n;
+    }
+    if (s->v2)
+    {
+        MatHeader header;
+        int bad_chunks;
+        if (matReadHeader(f_name, &header) != 0 || header.rows != (uint64_t)n || header.cols != (uint64_t)n)
+        {
+            return;
+        }
+        if (header.layout == MAT_ROW_MAJOR && header.dtype == MAT_F64)
+        {
+            // Chunks land straight in the slot
+            slot->ok = matReadInto(f_name, &header, slot->data, s->capacity * sizeof(double), &bad_chunks) == 0 && bad_chunks == 0;
+        }
+        else
+        {
+            void *data = matRead(f_name, &header, &bad_chunks);
+            if (data != NULL && bad_chunks == 0)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    matGetRow(&header, data, i, slot->rows[i]);
+                }
+                slot->ok = true;
+            }
+            free(data);
+        }
+    }
+    else
+    {
+        int fd = open(f_name, O_RDONLY);
+        if (fd >= 0)
+        {
+            slot->ok = preadFull(fd, slot->data, (size_t)n * n * sizeof(double), 0) == 0;
+            close(fd);
+        }
+    }
+    slot->read_time = omp_get_wtime() - start;
+}
+
+// Reader thread: loads the sweep in order, waiting while every slot holds an unfactored matrix.
+// Its OpenMP regions run on one thread so the reads do not compete with the factorization
+static void *matrixReader(void *arg)
+{
+    MatrixStream *s = arg;
+    omp_set_num_threads(1);
+    for (long k = 0; k < s->count; k++)
+    {
+        pthread_mutex_lock(&s->lock);
+        while (k - s->next_use >= MATRIX_SLOTS)
+        {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        matrixLoad(s, k);
+
+        pthread_mutex_lock(&s->lock);
+        s->next_read = k + 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+// Start reading a sweep of count matrices
+void matrixStreamStart(MatrixStream *s, const int *sizes, int count, bool v2)
+{
+    s->sizes = sizes;
+    s->count = count;
+    s->v2 = v2;
+    s->next_read = 0;
+    s->next_use = 0;
+    s->wait_time = 0;
+    pthread_create(&s->reader, NULL, matrixReader, s);
+}
+
+// Wait for matrix k to land and return its rows, or NULL when it could not be read
+double **matrixAcquire(MatrixStream *s, long k)
+{
+    double start = omp_get_wtime();
+    pthread_mutex_lock(&s->lock);
+    while (s->next_read <= k)
+    {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    s->wait_time += omp_get_wtime() - start;
+    MatrixSlot *slot = &s->slots[k % MATRIX_SLOTS];
+    return slot->ok ? slot->rows : NULL;
+}
+
+// Hand the slot of matrix k back to the reader
+void matrixRelease(MatrixStream *s, long k)
+{
+    pthread_mutex_lock(&s->lock);
+    s->next_use = k + 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void matrixStreamJoin(MatrixStream *s)
+{
+    pthread_join(s->reader, NULL);
+}
+
+void matrixStreamFree(MatrixStream *s)
+{
+    for (int k = 0; k < MATRIX_SLOTS; k++)
+    {
+        free(s->slots[k].rows);
+        free(s->slots[k].data);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file matstream.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Load/compute pipeline for the determinant sweeps. A reader thread loads the matrices of a
+ * sweep in order into a ring of MATRIX_SLOTS buffers, each big enough for the largest matrix
+ * present, staying at most MATRIX_SLOTS matrices ahead of the factorization, so matrix i + 1
+ * is read while matrix i is factored. Matrices come from input-matrix/ as raw row-major .bin
+ * files or as version 2 .dm2 files (see matfile.h). The buffers are allocated once and reused
+ * by every sweep. Build a program with it by adding matstream.c and matfile.c to its compile
+ * line along with -lpthread.
+ */
+#ifndef MATSTREAM_H
+#define MATSTREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Matrix buffers in the load/compute pipeline: one being factored, one being read
+#define MATRIX_SLOTS 2
+
+// One matrix buffer of the load/compute pipeline, big enough for the largest matrix
+typedef struct
+{
+    double **rows;
+    double *data;
+    bool ok;
+    double read_time;
+} MatrixSlot;
+
+// Matrices of a sweep read in order by a reader thread into a ring of MATRIX_SLOTS
+// buffers, staying at most MATRIX_SLOTS matrices ahead of the factorization
+typedef struct
+{
+    MatrixSlot slots[MATRIX_SLOTS];
+    size_t capacity; // doubles per slot
+    const int *sizes;
+    int count;
+    bool v2;
+    long next_read;
+    long next_use;
+    double wait_time;
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} MatrixStream;
+
+// Create the name of the input file for an n x n matrix
+void matrixPath(char *f_name, int n, bool v2);
+
+// Read a whole range with pread, retrying short reads; returns 0 on success
+int preadFull(int fd, void *buf, size_t bytes, off_t offset);
+
+// Size of the largest matrix of a sweep whose input file is present and holds an n x n
+// matrix, 0 when there is none. Matrices missing from the sweep take no buffer space
+int matrixLargest(const int *sizes, int count, bool v2);
+
+// Allocate the ring once for the largest matrix. Exits when the buffers cannot be allocated
+void matrixStreamInit(MatrixStream *s, int max_n);
+
+// Start reading a sweep of count matrices, .dm2 files when v2 is set
+void matrixStreamStart(MatrixStream *s, const int *sizes, int count, bool v2);
+
+// Wait for matrix k to land and return its rows, or NULL when it could not be read
+double **matrixAcquire(MatrixStream *s, long k);
+
+// Hand the slot of matrix k back to the reader
+void matrixRelease(MatrixStream *s, long k);
+
+// Wait for the reader to finish the sweep
+void matrixStreamJoin(MatrixStream *s);
+
+void matrixStreamFree(MatrixStream *s);
+
+#endif
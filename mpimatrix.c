@@ -0,0 +1,484 @@
+/**
+ * @file mpimatrix.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Compile:  mpicc -Wall -g -o mpimatrix.o mpimatrix.c -fopenmp -std=c99 -lm
+ * Usage: mpirun -np <ranks> ./mpimatrix.o [-n size] [-b block size] [-g process rows]
+ *        The matrix is dealt out 2D block-cyclically over a process rows x (ranks / process rows)
+ *        grid; every rank reads only its own blocks from the .bin file. Each rank's trailing
+ *        update runs on OMP_NUM_THREADS threads. On one machine run as many ranks as wanted
+ *        with mpirun --oversubscribe -np K.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <mpi.h>
+#include <omp.h>
+
+// Where this rank sits in the process grid and the communicators along its row and column
+typedef struct
+{
+    int rank;
+    int ranks;
+    int prows;
+    int pcols;
+    int myrow;
+    int mycol;
+    MPI_Comm row_comm; // ranks with the same process row, ranked by process column
+    MPI_Comm col_comm; // ranks with the same process column, ranked by process row
+} Grid;
+
+// This rank's share of a block-cyclic matrix, stored row-major with mloc rows of nloc columns
+typedef struct
+{
+    int n;
+    int nb;
+    int mloc;
+    int nloc;
+    double *a;
+} LocalMatrix;
+
+// Seconds this rank spent reading its blocks, computing and waiting in MPI calls
+typedef struct
+{
+    double read;
+    double compute;
+    double comm;
+} RankTimes;
+
+double comm_time;
+
+// Time an MPI call as communication
+#define COMM(call)                            \
+    do                                        \
+    {                                         \
+        double comm_start = MPI_Wtime();      \
+        call;                                 \
+        comm_time += MPI_Wtime() - comm_start; \
+    } while (0)
+
+int numroc(int n, int nb, int p, int nprocs);
+int globalToLocal(int g, int nb, int nprocs);
+int localToGlobal(int l, int nb, int p, int nprocs);
+int ownerOf(int g, int nb, int nprocs);
+void setupGrid(Grid *grid, int prows);
+bool readBlocks(const char *f_name, Grid *grid, LocalMatrix *m, double *read_time);
+void swapRows(Grid *grid, LocalMatrix *m, int r1, int r2, int col0, int ncol, double *buf);
+void PLUDeterminantMPI(Grid *grid, LocalMatrix *m, long double *det, long double *det10);
+
+int main(int argc, char *argv[])
+{
+    char f_name[50];
+
+    int sizes[] = {16, 32, 64, 128, 256, 496, 512, 1000, 1024, 2000, 2048, 3000, 4000, 4096};
+
+    int only_size = 0;
+    int nb = 64;
+    int prows = 0;
+    Grid grid;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &grid.rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &grid.ranks);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            only_size = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            nb = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+        {
+            prows = strtol(argv[++i], NULL, 10);
+        }
+        else
+        {
+            if (grid.rank == 0)
+            {
+                printf("Unknown option %s.\n", argv[i]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (nb < 1 || (prows != 0 && (prows < 0 || grid.ranks % prows != 0)))
+    {
+        if (grid.rank == 0)
+        {
+            printf("Block size must be positive and process rows must divide %d ranks.\n", grid.ranks);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    setupGrid(&grid, prows);
+
+    if (grid.rank == 0)
+    {
+        printf("\n\n===MPI RUN - %d RANKS (%dx%d GRID), %d THREADS PER RANK===\n",
+               grid.ranks, grid.prows, grid.pcols, omp_get_max_threads());
+    }
+
+    for (int i = 0; i < 14; i++)
+    {
+        int arraySize = sizes[i];
+        if (only_size != 0 && arraySize != only_size)
+        {
+            continue;
+        }
+
+        LocalMatrix m;
+        RankTimes times;
+        long double det, det10;
+
+        m.n = arraySize;
+        m.nb = nb;
+        m.mloc = numroc(arraySize, nb, grid.myrow, grid.prows);
+        m.nloc = numroc(arraySize, nb, grid.mycol, grid.pcols);
+        m.a = malloc((size_t)m.mloc * m.nloc * sizeof(double));
+
+        sprintf(f_name, "input-matrix/m%04dx%04d.bin", arraySize, arraySize);
+        if (grid.rank == 0)
+        {
+            printf("\n(1) Reading array file %s in %dx%d blocks\n", f_name, nb, nb);
+            printf("(2) Size %dx%d\n", arraySize, arraySize);
+        }
+        if (!readBlocks(f_name, &grid, &m, &times.read))
+        {
+            if (grid.rank == 0)
+            {
+                printf("Error reading %s.\n", f_name);
+            }
+            free(m.a);
+            continue;
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        comm_time = 0;
+        double start = MPI_Wtime();
+        PLUDeterminantMPI(&grid, &m, &det, &det10);
+        double end = MPI_Wtime();
+        times.comm = comm_time;
+        times.compute = (end - start) - comm_time;
+
+        RankTimes *all = NULL;
+        if (grid.rank == 0)
+        {
+            all = malloc(grid.ranks * sizeof(RankTimes));
+        }
+        MPI_Gather(&times, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+        if (grid.rank == 0)
+        {
+            printf("(3) Determinant: %.6Le in %fs\n", det, (end - start));
+            printf("(4) Log10 |Determinant|: %.6Le\n", det10);
+            for (int r = 0; r < grid.ranks; r++)
+            {
+                printf("    rank %d (%d,%d): read %fs, compute %fs, communication %fs\n",
+                       r, r / grid.pcols, r % grid.pcols, all[r].read, all[r].compute, all[r].comm);
+            }
+            free(all);
+        }
+        free(m.a);
+    }
+
+    MPI_Comm_free(&grid.row_comm);
+    MPI_Comm_free(&grid.col_comm);
+    MPI_Finalize();
+    return 0;
+}
+
+// Number of the first n indices that process p of nprocs owns when dealt out in blocks of nb
+int numroc(int n, int nb, int p, int nprocs)
+{
+    int blocks = n / nb;
+    int count = (blocks / nprocs) * nb;
+    int extra = blocks % nprocs;
+    if (p < extra)
+    {
+        count += nb;
+    }
+    else if (p == extra)
+    {
+        count += n % nb;
+    }
+    return count;
+}
+
+int globalToLocal(int g, int nb, int nprocs)
+{
+    return (g / (nb * nprocs)) * nb + g % nb;
+}
+
+int localToGlobal(int l, int nb, int p, int nprocs)
+{
+    return ((l / nb) * nprocs + p) * nb + l % nb;
+}
+
+int ownerOf(int g, int nb, int nprocs)
+{
+    return (g / nb) % nprocs;
+}
+
+// Lay the ranks out row by row on the most square grid with prows rows (0 picks it)
+void setupGrid(Grid *grid, int prows)
+{
+    if (prows == 0)
+    {
+        prows = 1;
+        for (int p = 1; p * p <= grid->ranks; p++)
+        {
+            if (grid->ranks % p == 0)
+            {
+                prows = p;
+            }
+        }
+    }
+    grid->prows = prows;
+    grid->pcols = grid->ranks / prows;
+    grid->myrow = grid->rank / grid->pcols;
+    grid->mycol = grid->rank % grid->pcols;
+    MPI_Comm_split(MPI_COMM_WORLD, grid->myrow, grid->mycol, &grid->row_comm);
+    MPI_Comm_split(MPI_COMM_WORLD, grid->mycol, grid->myrow, &grid->col_comm);
+}
+
+// Every rank reads the row segments of its own blocks straight from the file with offset reads
+bool readBlocks(const char *f_name, Grid *grid, LocalMatrix *m, double *read_time)
+{
+    MPI_File fh;
+    int ok = 1;
+    double start = MPI_Wtime();
+
+    if (MPI_File_open(MPI_COMM_WORLD, f_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        return false;
+    }
+    for (int r = 0; r < m->mloc && ok; r++)
+    {
+        int gi = localToGlobal(r, m->nb, grid->myrow, grid->prows);
+        for (int c = 0; c < m->nloc; c += m->nb)
+        {
+            int gj = localToGlobal(c, m->nb, grid->mycol, grid->pcols);
+            int count = m->nloc - c < m->nb ? m->nloc - c : m->nb;
+            MPI_Status status;
+            int got;
+            MPI_Offset offset = ((MPI_Offset)gi * m->n + gj) * sizeof(double);
+            if (MPI_File_read_at(fh, offset, m->a + (size_t)r * m->nloc + c, count, MPI_DOUBLE, &status) != MPI_SUCCESS)
+            {
+                ok = 0;
+                break;
+            }
+            MPI_Get_count(&status, MPI_DOUBLE, &got);
+            if (got != count)
+            {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    MPI_File_close(&fh);
+    *read_time = MPI_Wtime() - start;
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return ok != 0;
+}
+
+// Swap global rows r1 and r2 over local columns [col0, col0 + ncol) inside a process column;
+// every rank of the column calls it, only the owners of the two rows do anything
+void swapRows(Grid *grid, LocalMatrix *m, int r1, int r2, int col0, int ncol, double *buf)
+{
+    int own1 = ownerOf(r1, m->nb, grid->prows);
+    int own2 = ownerOf(r2, m->nb, grid->prows);
+    if (ncol <= 0 || (grid->myrow != own1 && grid->myrow != own2))
+    {
+        return;
+    }
+    if (own1 == own2)
+    {
+        double *x = m->a + (size_t)globalToLocal(r1, m->nb, grid->prows) * m->nloc + col0;
+        double *y = m->a + (size_t)globalToLocal(r2, m->nb, grid->prows) * m->nloc + col0;
+        for (int c = 0; c < ncol; c++)
+        {
+            double temp = x[c];
+            x[c] = y[c];
+            y[c] = temp;
+        }
+        return;
+    }
+    int mine = grid->myrow == own1 ? r1 : r2;
+    int other = grid->myrow == own1 ? own2 : own1;
+    double *x = m->a + (size_t)globalToLocal(mine, m->nb, grid->prows) * m->nloc + col0;
+    COMM(MPI_Sendrecv(x, ncol, MPI_DOUBLE, other, 0, buf, ncol, MPI_DOUBLE, other, 0, grid->col_comm, MPI_STATUS_IGNORE));
+    memcpy(x, buf, ncol * sizeof(double));
+}
+
+// Right-looking block LU with partial pivoting on the block-cyclic matrix. For each block
+// column the owning process column factors the panel, pivots are found with a MAXLOC
+// reduction down the column; the L panel and pivots are broadcast along process rows, the
+// U row block down process columns, and every rank updates its part of the trailing matrix
+void PLUDeterminantMPI(Grid *grid, LocalMatrix *m, long double *det, long double *det10)
+{
+    int n = m->n;
+    int nb = m->nb;
+    int lda = m->nloc;
+    double *a = m->a;
+    int nswaps = 0;
+    long double prod = 1;
+    long double logsum = 0;
+
+    int *piv = malloc(nb * sizeof(int));
+    double *pivrow = malloc(nb * sizeof(double));
+    double *lp = malloc((size_t)m->mloc * nb * sizeof(double));
+    double *up = malloc((size_t)m->nloc * nb * sizeof(double));
+    double *buf = malloc(((size_t)m->nloc + nb) * sizeof(double));
+
+    for (int k0 = 0; k0 < n; k0 += nb)
+    {
+        int kw = n - k0 < nb ? n - k0 : nb;
+        int k1 = k0 + kw;
+        int pcol = ownerOf(k0, nb, grid->pcols);
+        int prow = ownerOf(k0, nb, grid->prows);
+        int rk0 = numroc(k0, nb, grid->myrow, grid->prows); // first local row at or below k0
+        int rk1 = numroc(k1, nb, grid->myrow, grid->prows);
+        int c1 = numroc(k1, nb, grid->mycol, grid->pcols); // first local trailing column
+        int ncol = m->nloc - c1;
+
+        // Panel factorization in the owning process column
+        if (grid->mycol == pcol)
+        {
+            int lc0 = globalToLocal(k0, nb, grid->pcols);
+            for (int j = k0; j < k1; j++)
+            {
+                int jc = lc0 + (j - k0);
+                int rj = numroc(j, nb, grid->myrow, grid->prows);
+                struct
+                {
+                    double v;
+                    int i;
+                } best = {-1.0, n}, pick;
+                for (int r = rj; r < m->mloc; r++)
+                {
+                    double v = fabs(a[(size_t)r * lda + jc]);
+                    if (v > best.v)
+                    {
+                        best.v = v;
+                        best.i = localToGlobal(r, nb, grid->myrow, grid->prows);
+                    }
+                }
+                COMM(MPI_Allreduce(&best, &pick, 1, MPI_DOUBLE_INT, MPI_MAXLOC, grid->col_comm));
+                piv[j - k0] = pick.i;
+                if (pick.i != j)
+                {
+                    swapRows(grid, m, j, pick.i, lc0, kw, buf);
+                }
+
+                int ownj = ownerOf(j, nb, grid->prows);
+                int len = k1 - j;
+                if (grid->myrow == ownj)
+                {
+                    memcpy(pivrow, a + (size_t)globalToLocal(j, nb, grid->prows) * lda + jc, len * sizeof(double));
+                }
+                COMM(MPI_Bcast(pivrow, len, MPI_DOUBLE, ownj, grid->col_comm));
+                if (grid->myrow == ownj)
+                {
+                    prod *= pivrow[0];
+                    logsum += log10(fabs(pivrow[0]));
+                }
+                if (pivrow[0] == 0)
+                {
+                    continue; // singular, the column is already zero below the diagonal
+                }
+                for (int r = numroc(j + 1, nb, grid->myrow, grid->prows); r < m->mloc; r++)
+                {
+                    double *row = a + (size_t)r * lda + jc;
+                    double factor = row[0] / pivrow[0];
+                    row[0] = factor;
+                    for (int c = 1; c < len; c++)
+                    {
+                        row[c] -= factor * pivrow[c];
+                    }
+                }
+            }
+            for (int r = rk0; r < m->mloc; r++)
+            {
+                memcpy(lp + (size_t)r * kw, a + (size_t)r * lda + lc0, kw * sizeof(double));
+            }
+        }
+
+        // Panel broadcast: pivots and L columns go along each process row
+        COMM(MPI_Bcast(piv, kw, MPI_INT, pcol, grid->row_comm));
+        COMM(MPI_Bcast(lp + (size_t)rk0 * kw, (m->mloc - rk0) * kw, MPI_DOUBLE, pcol, grid->row_comm));
+
+        for (int j = k0; j < k1; j++)
+        {
+            if (piv[j - k0] != j)
+            {
+                nswaps++;
+                swapRows(grid, m, j, piv[j - k0], c1, ncol, buf);
+            }
+        }
+        if (ncol <= 0)
+        {
+            continue;
+        }
+
+        // U row block: the owning process row solves with the unit lower panel, then sends it down
+        if (grid->myrow == prow)
+        {
+            int rr0 = globalToLocal(k0, nb, grid->prows);
+            for (int i = 1; i < kw; i++)
+            {
+                double *row = a + (size_t)(rr0 + i) * lda + c1;
+                for (int jj = 0; jj < i; jj++)
+                {
+                    double factor = lp[(size_t)(rr0 + i) * kw + jj];
+                    double *urow = a + (size_t)(rr0 + jj) * lda + c1;
+                    for (int c = 0; c < ncol; c++)
+                    {
+                        row[c] -= factor * urow[c];
+                    }
+                }
+            }
+            for (int i = 0; i < kw; i++)
+            {
+                memcpy(up + (size_t)i * ncol, a + (size_t)(rr0 + i) * lda + c1, ncol * sizeof(double));
+            }
+        }
+        COMM(MPI_Bcast(up, kw * ncol, MPI_DOUBLE, prow, grid->col_comm));
+
+        // Distributed trailing update of this rank's rows and columns below and right of the panel
+        #pragma omp parallel for schedule(static)
+        for (int r = rk1; r < m->mloc; r++)
+        {
+            double *row = a + (size_t)r * lda + c1;
+            for (int jj = 0; jj < kw; jj++)
+            {
+                double factor = lp[(size_t)r * kw + jj];
+                double *urow = up + (size_t)jj * ncol;
+                for (int c = 0; c < ncol; c++)
+                {
+                    row[c] -= factor * urow[c];
+                }
+            }
+        }
+    }
+
+    COMM(MPI_Reduce(&prod, det, 1, MPI_LONG_DOUBLE, MPI_PROD, 0, MPI_COMM_WORLD));
+    COMM(MPI_Reduce(&logsum, det10, 1, MPI_LONG_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD));
+    if (nswaps % 2 != 0)
+    {
+        *det *= -1;
+    }
+
+    free(piv);
+    free(pivrow);
+    free(lp);
+    free(up);
+    free(buf);
+}
@@ -1,10 +1,24 @@
 /**
- * @file matrixvector.c
+ * @file parallelmatrix.c
  * @authors Camp Steiner, Jeff Luong
  *
- * Compile:  gcc -Wall -g -o parallelmatrix.o parallelmatrix.c -fopenmp -std=c99 -lm
- * Usage: ./parallelmatrix.o
+ * Compile:  gcc -Wall -g -O3 -march=native -ffp-contract=fast -o parallelmatrix.o parallelmatrix.c gemm.c matfile.c matstream.c arena.c -fopenmp -std=c99 -lm -lpthread
+ * Usage: ./parallelmatrix.o [-m omp|ooc|mixed|recursive|calu|blocked|pool|auto] [-w panel width] [-p panels in memory] [-e log10 tolerance]
+ *                           [-b none|close|spread] [-i bin|v2]
+ *        ooc streams column panels from the .bin file instead of loading the matrix
+ *        mixed factors in float32 and falls back to double when the error estimate exceeds -e
+ *        recursive is a cache-oblivious divide-and-conquer LU using OpenMP tasks
+ *        calu picks each panel's pivots by a parallel tournament (communication-avoiding LU)
+ *        blocked factors LU_BLOCK wide panels and does each trailing update as one packed gemm
+ *        pool runs the OMP elimination inside one parallel region, each thread owning rows
+ *        i % T, with spinning barriers between steps; it reports the time spent waiting
+ *        auto measures the bandwidth and density of each matrix and uses a banded LU or a
+ *        sparse LU with a minimum degree ordering when they apply, dense OMP otherwise
+ *        -b pins thread t to a CPU, filling one NUMA node at a time (close) or round robin
+ *        over the nodes (spread); none leaves placement to OMP_PROC_BIND / OMP_PLACES
+ *        -i v2 reads the .dm2 files made by matconvert (chunked, CRC32C checked) instead of .bin
  */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,10 +26,158 @@
 #include <omp.h>
 #include <math.h>
 #include <stdbool.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include "gemm.h"
+#include "matfile.h"
+#include "arena.h"
+#include "matstream.h"
+
+// Determinant methods selectable with -m
+typedef enum
+{
+    METHOD_OMP,
+    METHOD_OOC,
+    METHOD_MIXED,
+    METHOD_RECURSIVE,
+    METHOD_CALU,
+    METHOD_BLOCKED,
+    METHOD_POOL,
+    METHOD_AUTO,
+    METHOD_BANDED,
+    METHOD_SPARSE
+} Method;
+
+// Mixed precision limits: probes for the trace estimate, largest pivot growth and
+// largest cond * float epsilon before the float32 factors are not trusted
+#define MIXED_PROBES 8
+#define MIXED_MAX_GROWTH 1e4
+#define MIXED_MAX_COND_EPS 1e-1
+
+// Recursive LU: panels of at most RLU_BASE columns and blocks of at most RLU_BASE_WORK
+// multiply-adds use the plain loops, blocks above RLU_TASK_WORK are split into tasks
+#define RLU_BASE 8
+#define RLU_BASE_WORK (32 * 32 * 32)
+#define RLU_TASK_WORK (128 * 128 * 128)
+
+// Columns per CALU panel
+#define CALU_PANEL 32
+
+// Columns per blocked LU panel, the depth of each gemm trailing update
+#define LU_BLOCK 128
+
+// Pool barriers spin this many times between yields, so oversubscribed runs still progress;
+// with more threads than online CPUs they yield on every check
+#define POOL_SPIN_LIMIT 4096
+#define CACHE_LINE 64
+
+// Auto dispatch: banded when the band is at most n / BANDED_MAX_FRACTION wide, sparse when
+// at most SPARSE_MAX_DENSITY of the entries are nonzero. Banded elimination steps with less
+// work than BANDED_PARALLEL_WORK stay serial. The sparse LU keeps the diagonal pivot of the
+// ordered column while it is within SPARSE_PIVOT_TOL of the largest candidate
+#define BANDED_MAX_FRACTION 8
+#define SPARSE_MAX_DENSITY 0.05
+#define BANDED_PARALLEL_WORK 4096
+#define SPARSE_PIVOT_TOL 0.1
+
+// Nonzero structure found by the loader: lower and upper bandwidth and nonzero count
+typedef struct
+{
+    int kl;
+    int ku;
+    long nnz;
+} MatrixShape;
+
+// Compressed sparse column matrix
+typedef struct
+{
+    int n;
+    int *p;
+    int *i;
+    double *x;
+} SparseMatrix;
+
+// What the mixed precision determinant found and which path it took
+typedef struct
+{
+    bool used_float;
+    double growth;
+    double cond;
+    double error;
+} MixedReport;
+
+// Barrier waits of the pool determinant, summed over steps
+typedef struct
+{
+    long barriers;
+    double elapsed;
+    double wait_total; // over all threads
+    double wait_max;   // of the thread that waited longest
+} PoolReport;
+
+// Centralized sense-reversing barrier. The arrival count and the sense flag sit on separate
+// cache lines so arrivals do not disturb the spinning threads
+typedef struct
+{
+    int count;
+    char pad0[CACHE_LINE - sizeof(int)];
+    int sense;
+    char pad1[CACHE_LINE - sizeof(int)];
+    int threads;
+    int spin_limit;
+} SpinBarrier;
+
+// Thread placement selectable with -b
+typedef enum
+{
+    BIND_NONE,
+    BIND_CLOSE,
+    BIND_SPREAD
+} Binding;
+
+// NUMA topology: the CPUs of every node, and the node each OpenMP thread runs on
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+#define NUMA_STREAM_DOUBLES (1 << 20)
+int numa_nodes;
+int numa_ncpus[NUMA_MAX_NODES];
+int numa_cpus[NUMA_MAX_NODES][NUMA_MAX_CPUS];
+int thread_node[NUMA_MAX_CPUS];
+// Keeps the bandwidth loop from being optimised away
+volatile double stream_sink;
+
+// Scratch of the in-memory determinants, sized once per problem by workspaceBytes. Each
+// PLUDeterminant* call takes a mark on entry and releases to it before returning
+Arena workspace;
+// Rows copied by workspaceCopy, on 4 KB pages mapped afresh for every matrix so that its
+// first touch places them for this size and thread count, not for whichever ran first
+Arena matrix_rows;
 
 // Function headers
 long double PLUDeterminantSerial(double **a, int n, bool lt);
 long double PLUDeterminantOMP(double **a, int n, bool lt);
+long double PLUDeterminantOOC(const char *f_name, int n, bool lt, int width, int panels);
+long double PLUDeterminantMixed(double **a, int n, bool lt, double tol, MixedReport *report);
+long double PLUDeterminantRecursive(double **a, int n, bool lt, bool parallel);
+long double PLUDeterminantCALU(double **a, int n, bool lt);
+long double PLUDeterminantBlocked(double **a, int n, bool lt);
+long double PLUDeterminantPool(double **a, int n, bool lt, PoolReport *report);
+void spinBarrierWait(SpinBarrier *b, int *local_sense);
+long double PLUDeterminantBanded(double **a, int n, int kl, int ku, bool lt);
+long double PLUDeterminantSparse(double **a, int n, bool lt);
+void matrixShape(double **a, int n, MatrixShape *shape);
+Method chooseMethod(const MatrixShape *shape, int n);
+long double runDeterminant(Method method, double **a, int n, bool lt, double tol, MixedReport *report, PoolReport *pool, const MatrixShape *shape);
+size_t workspaceBytes(int n, int nthreads);
+size_t workspaceRowsBytes(int n, int nthreads);
+double **workspaceCopy(double **arr, int n);
+void readTopology(void);
+void pinThreads(Binding binding);
+void reportNodeBandwidth(void);
 
 int main(int argc, char *argv[])
 {
@@ -25,7 +187,122 @@ int main(int argc, char *argv[])
 
     int threads[] = {2, 4, 8, 16, 32, 64, 128};
 
+    Method method = METHOD_OMP;
+    int width = 256;
+    int panels = 4;
+    double tol = 1e-3;
+    Binding binding = BIND_NONE;
+    MixedReport report;
+    PoolReport pool;
+    MatrixShape shape = {0, 0, 0};
+    bool v2 = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "omp") == 0)
+            {
+                method = METHOD_OMP;
+            }
+            else if (strcmp(argv[i], "ooc") == 0)
+            {
+                method = METHOD_OOC;
+            }
+            else if (strcmp(argv[i], "mixed") == 0)
+            {
+                method = METHOD_MIXED;
+            }
+            else if (strcmp(argv[i], "recursive") == 0)
+            {
+                method = METHOD_RECURSIVE;
+            }
+            else if (strcmp(argv[i], "calu") == 0)
+            {
+                method = METHOD_CALU;
+            }
+            else if (strcmp(argv[i], "blocked") == 0)
+            {
+                method = METHOD_BLOCKED;
+            }
+            else if (strcmp(argv[i], "pool") == 0)
+            {
+                method = METHOD_POOL;
+            }
+            else if (strcmp(argv[i], "auto") == 0)
+            {
+                method = METHOD_AUTO;
+            }
+            else
+            {
+                printf("Unknown method %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            width = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            panels = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            tol = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "close") == 0)
+            {
+                binding = BIND_CLOSE;
+            }
+            else if (strcmp(argv[i], "spread") == 0)
+            {
+                binding = BIND_SPREAD;
+            }
+            else if (strcmp(argv[i], "none") != 0)
+            {
+                printf("Unknown binding %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "v2") == 0)
+            {
+                v2 = true;
+            }
+            else if (strcmp(argv[i], "bin") != 0)
+            {
+                printf("Unknown input format %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+    }
+    if (method == METHOD_OOC && (width < 1 || panels < 2))
+    {
+        printf("Out-of-core needs a panel width of at least 1 and at least 2 panels in memory.\n");
+        return 1;
+    }
+
     omp_set_dynamic(0); // force using thread_num
+    readTopology();
+
+    // Two buffers of the largest matrix present, reused by every sweep
+    MatrixStream stream;
+    if (method != METHOD_OOC)
+    {
+        matrixStreamInit(&stream, matrixLargest(sizes, 14, v2));
+    }
 
     for (int t = 0; t < 7; t++)
     {
@@ -33,43 +310,110 @@ int main(int argc, char *argv[])
 
         printf("\n\n===PARALLEL RUN - %d THREADS===\n", threads[t]);
 
+        pinThreads(binding);
+        reportNodeBandwidth();
+
+        // Matrix i + 1 is read while matrix i is factored
+        double sweep_start = omp_get_wtime();
+        if (method != METHOD_OOC)
+        {
+            matrixStreamStart(&stream, sizes, 14, v2);
+        }
+
         for (int i = 0; i < 14; i++)
         {
             int arraySize = sizes[i];
 
-            double **a = malloc(arraySize * sizeof(double));
-            // Create filename
-            sprintf(f_name, "input-matrix/m%04dx%04d.bin", arraySize, arraySize);
-            // sprintf(f_name, "input-matrix/m0256x0256.bin");
+            if (method == METHOD_OOC)
+            {
+                sprintf(f_name, "input-matrix/m%04dx%04d.bin", arraySize, arraySize);
+                printf("\n(1) Streaming array file %s (%d panels of %d columns in memory)\n", f_name, panels, width);
+                printf("(2) Size %dx%d\n", arraySize, arraySize);
+
+                double start, end;
+
+                start = omp_get_wtime();
+                long double det = PLUDeterminantOOC(f_name, arraySize, false, width, panels);
+                end = omp_get_wtime();
+                printf("(3) Determinant: %.6Le in %fs\n", det, (end - start));
+
+                start = omp_get_wtime();
+                long double det10 = PLUDeterminantOOC(f_name, arraySize, true, width, panels);
+                end = omp_get_wtime();
+                printf("(4) Log10 |Determinant|: %.6Le in %fs\n", det10, (end - start));
+                continue;
+            }
+
+            matrixPath(f_name, arraySize, v2);
             printf("\n(1) Reading array file %s\n", f_name);
             printf("(2) Size %dx%d\n", arraySize, arraySize);
-            // Open file
-            FILE *datafile = fopen(f_name, "rb");
-            // Read elelements
-            for (int i = 0; i < arraySize; i++)
+            // Read on the reader thread while the previous matrix was being factored
+            double **a = matrixAcquire(&stream, i);
+            if (a == NULL)
             {
-                a[i] = (double *)malloc(arraySize * sizeof(double));
-                for (int j = 0; j < arraySize; j++)
-                {
-                    fread(&a[i][j], sizeof(double), 1, datafile);
-                    // printf("%f,", a[i][j]);
-                }
-                // printf("\n");
+                printf("Error reading %s.\n", f_name);
+                matrixRelease(&stream, i);
+                continue;
+            }
+            printf("    Read in %fs behind the previous factorization\n", stream.slots[i % MATRIX_SLOTS].read_time);
+            arenaFree(&matrix_rows);
+            if (arenaReserve(&workspace, workspaceBytes(arraySize, threads[t])) != 0 ||
+                arenaInitSmall(&matrix_rows, workspaceRowsBytes(arraySize, threads[t])) != 0)
+            {
+                printf("Error mapping the workspace for %s.\n", f_name);
+                matrixRelease(&stream, i);
+                continue;
             }
-            // printf("Matrix has been read.\n");
-            fclose(datafile);
 
             double start, end;
 
+            Method used = method;
+            if (method == METHOD_AUTO)
+            {
+                start = omp_get_wtime();
+                matrixShape(a, arraySize, &shape);
+                used = chooseMethod(&shape, arraySize);
+                end = omp_get_wtime();
+                printf("    Bandwidth %d lower, %d upper, %ld nonzeros (%.2f%%), using %s LU (checked in %fs)\n",
+                       shape.kl, shape.ku, shape.nnz, 100.0 * shape.nnz / ((double)arraySize * arraySize),
+                       used == METHOD_BANDED ? "banded" : used == METHOD_SPARSE ? "sparse" : "dense", (end - start));
+            }
+
             start = omp_get_wtime();
-            long double det = PLUDeterminantOMP(a, arraySize, false);
+            long double det = runDeterminant(used, a, arraySize, false, tol, &report, &pool, &shape);
             end = omp_get_wtime();
+            double special = end - start;
             printf("(3) Determinant: %.6Le in %fs\n", det, (end - start));
 
             start = omp_get_wtime();
-            long double det10 = PLUDeterminantOMP(a, arraySize, true);
+            long double det10 = runDeterminant(used, a, arraySize, true, tol, &report, &pool, &shape);
             end = omp_get_wtime();
-            printf("(4) Log10 Determinant: %.6Le in %fs\n", det10, (end - start));
+            printf("(4) Log10 |Determinant|: %.6Le in %fs\n", det10, (end - start));
+
+            if (used == METHOD_BANDED || used == METHOD_SPARSE)
+            {
+                start = omp_get_wtime();
+                long double dense = PLUDeterminantOMP(a, arraySize, false);
+                end = omp_get_wtime();
+                printf("(5) Dense OMP determinant %.6Le in %fs, %s LU saved %fs\n",
+                       dense, (end - start), used == METHOD_BANDED ? "banded" : "sparse", (end - start) - special);
+            }
+
+            printf("    Workspace %.1f MB on %s pages, %.1f MB used at most, rows %.1f MB on %s pages\n",
+                   workspace.size / 1048576.0, arenaPagesName(&workspace), workspace.peak / 1048576.0,
+                   matrix_rows.size / 1048576.0, arenaPagesName(&matrix_rows));
+
+            if (method == METHOD_POOL)
+            {
+                printf("(5) Barrier wait over %ld barriers: %.6fs max per thread (%.1f%% of the factorization), %.6fs all threads\n",
+                       pool.barriers, pool.wait_max, 100 * pool.wait_max / pool.elapsed, pool.wait_total);
+            }
+
+            if (method == METHOD_MIXED)
+            {
+                printf("(5) %s: growth %.2e, cond1 ~ %.2e, log10 error ~ %.2e\n",
+                       report.used_float ? "float32 factorization" : "fell back to double", report.growth, report.cond, report.error);
+            }
 
             // FILE *f = fopen("out.csv", "w");
             // if (f == NULL)
@@ -90,22 +434,106 @@ int main(int argc, char *argv[])
 
             // // close the file
             // fclose(f);
+
+            matrixRelease(&stream, i);
+        }
+
+        if (method != METHOD_OOC)
+        {
+            matrixStreamJoin(&stream);
+            printf("\n===%d matrices in %fs, %fs of it waiting for reads===\n", stream.count, omp_get_wtime() - sweep_start, stream.wait_time);
         }
     }
 
+    if (method != METHOD_OOC)
+    {
+        matrixStreamFree(&stream);
+    }
+    arenaFree(&workspace);
+    arenaFree(&matrix_rows);
+
     return 0;
 }
 
-long double PLUDeterminantSerial(double **arr, int n, bool lt)
+// Dispatch to the in-memory determinant selected with -m
+long double runDeterminant(Method method, double **a, int n, bool lt, double tol, MixedReport *report, PoolReport *pool, const MatrixShape *shape)
 {
-    // Copy array into local variable so arr doesn't get modified
-    int nswaps = 0;
-    double **a = malloc(n * sizeof(double));
+    switch (method)
+    {
+    case METHOD_BANDED:
+        return PLUDeterminantBanded(a, n, shape->kl, shape->ku, lt);
+    case METHOD_SPARSE:
+        return PLUDeterminantSparse(a, n, lt);
+    case METHOD_MIXED:
+        return PLUDeterminantMixed(a, n, lt, tol, report);
+    case METHOD_RECURSIVE:
+        return PLUDeterminantRecursive(a, n, lt, true);
+    case METHOD_CALU:
+        return PLUDeterminantCALU(a, n, lt);
+    case METHOD_BLOCKED:
+        return PLUDeterminantBlocked(a, n, lt);
+    case METHOD_POOL:
+        return PLUDeterminantPool(a, n, lt, pool);
+    default:
+        return PLUDeterminantOMP(a, n, lt);
+    }
+}
+
+// Largest workspace any in-memory method needs for an n x n matrix on nthreads threads: two
+// matrices (mixed keeps its float factors while the double fallback runs), vectors, CALU's
+// per-thread tournament blocks and the alignment of each allocation
+size_t workspaceBytes(int n, int nthreads)
+{
+    size_t stride = (n + 7) / 8 * 8;
+    size_t matrix = stride * n * sizeof(double) + n * sizeof(double *);
+    size_t vectors = 16 * (size_t)n * sizeof(double);
+    size_t tournament = (size_t)nthreads * (2 * CALU_PANEL * CALU_PANEL * sizeof(double) + CALU_PANEL * sizeof(int) + 2 * CACHE_LINE);
+    return 2 * matrix + vectors + tournament + 32 * ARENA_ALIGN;
+}
+
+// Doubles in one thread's block of rows: every row it owns padded to a cache line, rounded
+// up to whole pages so no page holds two threads' rows
+static size_t rowBlock(int n, int nthreads)
+{
+    size_t stride = (n + 7) / 8 * 8;
+    size_t page = ARENA_PAGE / sizeof(double);
+    return ((n + nthreads - 1) / nthreads * stride + page - 1) / page * page;
+}
+
+// Bytes of matrix_rows that workspaceCopy takes for an n x n matrix on nthreads threads
+size_t workspaceRowsBytes(int n, int nthreads)
+{
+    return nthreads * rowBlock(n, nthreads) * sizeof(double) + n * sizeof(double *) + ARENA_ALIGN;
+}
+
+// Function to copy a matrix into matrix_rows, each row starting on a cache line. Row i is
+// copied by thread i % T, the thread that eliminates it in the OMP, pool and CALU methods,
+// into a page aligned block holding only that thread's rows, so first touch puts every row
+// on its owner's node. Only one copy is live at a time, so each copy starts the arena over
+double **workspaceCopy(double **arr, int n)
+{
+    int nthreads = omp_get_max_threads();
+    size_t stride = (n + 7) / 8 * 8;
+    size_t block = rowBlock(n, nthreads);
+    // The blocks go first, where the page aligned mapping starts
+    arenaReset(&matrix_rows);
+    double *rows = arenaAlloc(&matrix_rows, nthreads * block * sizeof(double));
+    double **a = arenaAlloc(&matrix_rows, n * sizeof(double *));
+    #pragma omp parallel for schedule(static, 1)
     for (int i = 0; i < n; i++)
     {
-        a[i] = (double *)malloc(n * sizeof(double));
+        a[i] = rows + (size_t)(i % nthreads) * block + (size_t)(i / nthreads) * stride;
         memcpy(a[i], arr[i], n * sizeof(double));
     }
+    return a;
+}
+
+long double PLUDeterminantSerial(double **arr, int n, bool lt)
+{
+    // Copy array into the workspace so arr doesn't get modified
+    size_t mark = arenaMark(&workspace);
+    int nswaps = 0;
+    double **a = workspaceCopy(arr, n);
     // perform PLU decomposition
     for (int k = 0; k < n; k++)
     {
@@ -151,13 +579,13 @@ long double PLUDeterminantSerial(double **arr, int n, bool lt)
     //     printf("\n");
     // }
 
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
+    // Determinant should just be the product of the diagonal now, or the sum of its log10s
+    long double det = lt ? 0 : 1;
     for (int i = 0; i < n; i++)
     {
         if (lt)
         {
-            det *= log10(fabs(a[i][i]));
+            det += log10(fabs(a[i][i]));
         }
         else
         {
@@ -169,19 +597,18 @@ long double PLUDeterminantSerial(double **arr, int n, bool lt)
     { // parity for permutations I think?
         det *= -1;
     }
+
+    arenaRelease(&workspace, mark);
     return det;
 }
 
 long double PLUDeterminantOMP(double **arr, int n, bool lt)
 {
-    // Copy array into local variable so arr doesn't get modified
+    // Copy array into the workspace so arr doesn't get modified; each row is copied by the
+    // thread that owns it during elimination
+    size_t mark = arenaMark(&workspace);
     int nswaps = 0;
-    double **a = malloc(n * sizeof(double));
-    for (int i = 0; i < n; i++)
-    {
-        a[i] = (double *)malloc(n * sizeof(double));
-        memcpy(a[i], arr[i], n * sizeof(double));
-    }
+    double **a = workspaceCopy(arr, n);
     // perform PLU decomposition
     for (int k = 0; k < n; k++)
     {
@@ -205,10 +632,14 @@ long double PLUDeterminantOMP(double **arr, int n, bool lt)
             nswaps++;
         }
 
-// elimination
-        #pragma omp parallel for
-        for (int i = k + 1; i < n; i++)
+// elimination; row i always goes to thread i % T, the thread that first touched it
+        #pragma omp parallel for schedule(static, 1)
+        for (int i = 0; i < n; i++)
         {
+            if (i <= k)
+            {
+                continue;
+            }
             double factor = a[i][k] / a[k][k];
             for (int j = k; j < n; j++)
             {
@@ -228,13 +659,13 @@ long double PLUDeterminantOMP(double **arr, int n, bool lt)
     //     printf("\n");
     // }
 
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
+    // Determinant should just be the product of the diagonal now, or the sum of its log10s
+    long double det = lt ? 0 : 1;
     for (int i = 0; i < n; i++)
     {
         if (lt)
         {
-            det *= log10(fabs(a[i][i]));
+            det += log10(fabs(a[i][i]));
         }
         else
         {
@@ -246,5 +677,1971 @@ long double PLUDeterminantOMP(double **arr, int n, bool lt)
     { // parity for permutations I think?
         det *= -1;
     }
+
+    arenaRelease(&workspace, mark);
+    return det;
+}
+
+// One read issued by the out-of-core panel reader
+typedef struct
+{
+    int fd;
+    off_t offset;
+    size_t bytes;
+    int need; // panels that must be in the scratch file before this read may start
+} PanelRead;
+
+// Ring of panel buffers filled ahead of the factorization by a reader thread
+typedef struct
+{
+    double **buffers;
+    int slots;
+    PanelRead *jobs;
+    long njobs;
+    long next_read;
+    long next_use;
+    int written;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} PanelStream;
+
+// Reader thread: fills the ring in job order, staying at most `slots` reads ahead
+void *panelReader(void *arg)
+{
+    PanelStream *s = arg;
+    for (long j = 0; j < s->njobs; j++)
+    {
+        pthread_mutex_lock(&s->lock);
+        while (j - s->next_use >= s->slots || s->written < s->jobs[j].need)
+        {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (preadFull(s->jobs[j].fd, s->buffers[j % s->slots], s->jobs[j].bytes, s->jobs[j].offset) != 0)
+        {
+            printf("Error reading panel data.\n");
+            exit(1);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        s->next_read = j + 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+// Wait for read j to land and return its buffer
+double *panelAcquire(PanelStream *s, long j)
+{
+    pthread_mutex_lock(&s->lock);
+    while (s->next_read <= j)
+    {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return s->buffers[j % s->slots];
+}
+
+// Hand buffer j back to the reader
+void panelRelease(PanelStream *s, long j)
+{
+    pthread_mutex_lock(&s->lock);
+    s->next_use = j + 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Out-of-core left-looking blocked LU. The file is row-major, so reading it as column-major
+// gives A^T, which has the same determinant, and every column panel of A^T is a contiguous
+// run of rows in the file. Factored panels are spilled to a scratch file and streamed back
+// for the updates of later panels. At most `panels` (>= 2) panels of n x width doubles are held
+// in memory: the panel being factored plus panels - 1 read-ahead buffers. The scratch file goes
+// to $TMPDIR, or /tmp, so the input directory may be read-only.
+long double PLUDeterminantOOC(const char *f_name, int n, bool lt, int width, int panels)
+{
+    int npanels = (n + width - 1) / width;
+    size_t panel_bytes = (size_t)n * width * sizeof(double);
+    int nswaps = 0;
+    long double det = lt ? 0 : 1;
+
+    int in_fd = open(f_name, O_RDONLY);
+    const char *tmpdir = getenv("TMPDIR");
+    char scratch_name[4096];
+    snprintf(scratch_name, sizeof(scratch_name), "%s/ooc-XXXXXX", tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp");
+    int scratch_fd = mkstemp(scratch_name);
+    if (in_fd < 0 || scratch_fd < 0)
+    {
+        printf("Error opening %s or the scratch file.\n", f_name);
+        exit(1);
+    }
+    unlink(scratch_name);
+
+    PanelStream s;
+    s.slots = panels - 1;
+    s.buffers = malloc(s.slots * sizeof(double *));
+    for (int i = 0; i < s.slots; i++)
+    {
+        s.buffers[i] = malloc(panel_bytes);
+    }
+    s.njobs = npanels + (long)npanels * (npanels - 1) / 2;
+    s.jobs = malloc(s.njobs * sizeof(PanelRead));
+    s.next_read = 0;
+    s.next_use = 0;
+    s.written = 0;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+
+    // Job order matches consumption: panel p from the input, then factored panels 0..p-1
+    long j = 0;
+    for (int p = 0; p < npanels; p++)
+    {
+        int cols = p == npanels - 1 ? n - p * width : width;
+        s.jobs[j++] = (PanelRead){in_fd, (off_t)p * panel_bytes, (size_t)cols * n * sizeof(double), 0};
+        for (int q = 0; q < p; q++)
+        {
+            s.jobs[j++] = (PanelRead){scratch_fd, (off_t)q * panel_bytes, panel_bytes, q + 1};
+        }
+    }
+
+    double *cur = malloc(panel_bytes);
+    int *piv = malloc(n * sizeof(int));
+
+    pthread_t reader;
+    pthread_create(&reader, NULL, panelReader, &s);
+
+    j = 0;
+    for (int p = 0; p < npanels; p++)
+    {
+        int c0 = p * width;
+        int cols = p == npanels - 1 ? n - c0 : width;
+
+        memcpy(cur, panelAcquire(&s, j), (size_t)cols * n * sizeof(double));
+        panelRelease(&s, j++);
+
+        // Bring in the updates from every panel to the left
+        for (int q = 0; q < p; q++)
+        {
+            double *L = panelAcquire(&s, j);
+            int k0 = q * width, k1 = k0 + width;
+
+            for (int k = k0; k < k1; k++)
+            {
+                if (piv[k] != k)
+                {
+                    for (int c = 0; c < cols; c++)
+                    {
+                        double temp = cur[(size_t)c * n + k];
+                        cur[(size_t)c * n + k] = cur[(size_t)c * n + piv[k]];
+                        cur[(size_t)c * n + piv[k]] = temp;
+                    }
+                }
+            }
+
+            // Triangular solve with the unit lower diagonal block, then the trailing update
+            #pragma omp parallel for
+            for (int c = 0; c < cols; c++)
+            {
+                double *b = &cur[(size_t)c * n];
+                for (int k = k0; k < k1; k++)
+                {
+                    const double *l = &L[(size_t)(k - k0) * n];
+                    double f = b[k];
+                    for (int i = k + 1; i < k1; i++)
+                    {
+                        b[i] -= l[i] * f;
+                    }
+                }
+                for (int k = k0; k < k1; k++)
+                {
+                    const double *l = &L[(size_t)(k - k0) * n];
+                    double f = b[k];
+                    #pragma omp simd
+                    for (int i = k1; i < n; i++)
+                    {
+                        b[i] -= l[i] * f;
+                    }
+                }
+            }
+
+            panelRelease(&s, j++);
+        }
+
+        // Factor the panel itself with partial pivoting
+        for (int jj = 0; jj < cols; jj++)
+        {
+            int k = c0 + jj;
+            double *col = &cur[(size_t)jj * n];
+
+            int i_max = k;
+            for (int i = k; i < n; i++)
+            {
+                if (fabs(col[i]) > fabs(col[i_max]))
+                {
+                    i_max = i;
+                }
+            }
+            piv[k] = i_max;
+            if (i_max != k)
+            {
+                for (int c = 0; c < cols; c++)
+                {
+                    double temp = cur[(size_t)c * n + k];
+                    cur[(size_t)c * n + k] = cur[(size_t)c * n + i_max];
+                    cur[(size_t)c * n + i_max] = temp;
+                }
+                nswaps++;
+            }
+
+            double pivot = col[k];
+            if (lt)
+            {
+                det += log10(fabs(pivot));
+            }
+            else
+            {
+                det *= pivot;
+            }
+            if (pivot == 0)
+            {
+                continue;
+            }
+
+            for (int i = k + 1; i < n; i++)
+            {
+                col[i] /= pivot;
+            }
+            #pragma omp parallel for
+            for (int c = jj + 1; c < cols; c++)
+            {
+                double *b = &cur[(size_t)c * n];
+                double f = b[k];
+                #pragma omp simd
+                for (int i = k + 1; i < n; i++)
+                {
+                    b[i] -= col[i] * f;
+                }
+            }
+        }
+
+        // Spill the factored panel so later panels can stream it back
+        if (p < npanels - 1)
+        {
+            if (pwrite(scratch_fd, cur, panel_bytes, (off_t)p * panel_bytes) != (ssize_t)panel_bytes)
+            {
+                printf("Error writing the scratch file.\n");
+                exit(1);
+            }
+            pthread_mutex_lock(&s.lock);
+            s.written = p + 1;
+            pthread_cond_broadcast(&s.cond);
+            pthread_mutex_unlock(&s.lock);
+        }
+    }
+
+    pthread_join(reader, NULL);
+
+    close(in_fd);
+    close(scratch_fd);
+    for (int i = 0; i < s.slots; i++)
+    {
+        free(s.buffers[i]);
+    }
+    free(s.buffers);
+    free(s.jobs);
+    free(cur);
+    free(piv);
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.cond);
+
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
     return det;
-}
\ No newline at end of file
+}
+
+// Solve (LU) x = b with the float factors of PA = LU, accumulating in double
+void mixedSolve(const float *f, const int *perm, int n, const double *b, double *x)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double sum = b[perm[i]];
+        const float *row = &f[(size_t)i * n];
+        for (int j = 0; j < i; j++)
+        {
+            sum -= row[j] * x[j];
+        }
+        x[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        double sum = x[i];
+        const float *row = &f[(size_t)i * n];
+        for (int j = i + 1; j < n; j++)
+        {
+            sum -= row[j] * x[j];
+        }
+        x[i] = sum / row[i];
+    }
+}
+
+// Solve A^T x = b with the same factors: U^T w = b, L^T v = w, x = P^T v
+void mixedSolveTransposed(const float *f, const int *perm, int n, const double *b, double *x, double *w)
+{
+    memcpy(w, b, n * sizeof(double));
+    for (int j = 0; j < n; j++)
+    {
+        const float *row = &f[(size_t)j * n];
+        w[j] /= row[j];
+        for (int i = j + 1; i < n; i++)
+        {
+            w[i] -= row[i] * w[j];
+        }
+    }
+    for (int j = n - 1; j >= 0; j--)
+    {
+        const float *row = &f[(size_t)j * n];
+        for (int i = 0; i < j; i++)
+        {
+            w[i] -= row[i] * w[j];
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        x[perm[i]] = w[i];
+    }
+}
+
+// Double precision LU of a contiguous copy, returns ln|det| and the sign; used as the fallback
+double luLogDeterminant(double **arr, int n, int *sign)
+{
+    size_t mark = arenaMark(&workspace);
+    double *a = arenaAlloc(&workspace, (size_t)n * n * sizeof(double));
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(&a[(size_t)i * n], arr[i], n * sizeof(double));
+    }
+
+    double lndet = 0;
+    *sign = 1;
+    for (int k = 0; k < n; k++)
+    {
+        int i_max = k;
+        for (int i = k; i < n; i++)
+        {
+            if (fabs(a[(size_t)i * n + k]) > fabs(a[(size_t)i_max * n + k]))
+            {
+                i_max = i;
+            }
+        }
+        if (i_max != k)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                double temp = a[(size_t)k * n + j];
+                a[(size_t)k * n + j] = a[(size_t)i_max * n + j];
+                a[(size_t)i_max * n + j] = temp;
+            }
+            *sign = -*sign;
+        }
+
+        double pivot = a[(size_t)k * n + k];
+        if (pivot == 0)
+        {
+            *sign = 0;
+            arenaRelease(&workspace, mark);
+            return -INFINITY;
+        }
+        lndet += log(fabs(pivot));
+        if (pivot < 0)
+        {
+            *sign = -*sign;
+        }
+
+        #pragma omp parallel for
+        for (int i = k + 1; i < n; i++)
+        {
+            double *row = &a[(size_t)i * n];
+            const double *prow = &a[(size_t)k * n];
+            double factor = row[k] / pivot;
+            #pragma omp simd
+            for (int j = k + 1; j < n; j++)
+            {
+                row[j] -= factor * prow[j];
+            }
+        }
+    }
+
+    arenaRelease(&workspace, mark);
+    return lndet;
+}
+
+// Mixed precision determinant: factor a float32 copy (half the memory traffic, twice the SIMD
+// lanes), then correct ln|det| by tr((LU)^-1 (PA - LU)), estimated with random probes solved
+// against the float factors in double. The probes also give an error estimate. The growth
+// factor and a Hager 1-norm condition estimate decide whether float32 can be trusted;
+// otherwise the double precision path runs instead. The path taken goes into *report.
+long double PLUDeterminantMixed(double **arr, int n, bool lt, double tol, MixedReport *report)
+{
+    size_t mark = arenaMark(&workspace);
+    float *f = arenaAlloc(&workspace, (size_t)n * n * sizeof(float));
+    int *perm = arenaAlloc(&workspace, n * sizeof(int));
+    double *x = arenaAlloc(&workspace, n * sizeof(double));
+    double *y = arenaAlloc(&workspace, n * sizeof(double));
+    double *z = arenaAlloc(&workspace, n * sizeof(double));
+    double *w = arenaAlloc(&workspace, n * sizeof(double));
+    double max_a = 0, norm_a = 0;
+    int sign = 1;
+    double lndet = 0;
+    bool singular = false;
+
+    #pragma omp parallel for reduction(max : max_a)
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            f[(size_t)i * n + j] = (float)arr[i][j];
+            max_a = fmax(max_a, fabs(arr[i][j]));
+        }
+    }
+    for (int j = 0; j < n; j++)
+    {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+        {
+            sum += fabs(arr[i][j]);
+        }
+        norm_a = fmax(norm_a, sum);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        perm[i] = i;
+    }
+
+    // float32 PLU decomposition
+    for (int k = 0; k < n && !singular; k++)
+    {
+        int i_max = k;
+        for (int i = k; i < n; i++)
+        {
+            if (fabsf(f[(size_t)i * n + k]) > fabsf(f[(size_t)i_max * n + k]))
+            {
+                i_max = i;
+            }
+        }
+        if (i_max != k)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                float temp = f[(size_t)k * n + j];
+                f[(size_t)k * n + j] = f[(size_t)i_max * n + j];
+                f[(size_t)i_max * n + j] = temp;
+            }
+            int temp = perm[k];
+            perm[k] = perm[i_max];
+            perm[i_max] = temp;
+            sign = -sign;
+        }
+
+        float pivot = f[(size_t)k * n + k];
+        if (pivot == 0)
+        {
+            singular = true;
+            break;
+        }
+        lndet += log(fabs(pivot));
+        if (pivot < 0)
+        {
+            sign = -sign;
+        }
+
+        #pragma omp parallel for
+        for (int i = k + 1; i < n; i++)
+        {
+            float *row = &f[(size_t)i * n];
+            const float *prow = &f[(size_t)k * n];
+            float factor = row[k] / pivot;
+            #pragma omp simd
+            for (int j = k + 1; j < n; j++)
+            {
+                row[j] -= factor * prow[j];
+            }
+            row[k] = factor;
+        }
+    }
+
+    report->used_float = false;
+    report->growth = 0;
+    report->cond = INFINITY;
+    report->error = INFINITY;
+
+    if (!singular)
+    {
+        // Pivot growth: largest entry of U against the largest entry of A
+        double max_u = 0;
+        #pragma omp parallel for reduction(max : max_u)
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = i; j < n; j++)
+            {
+                max_u = fmax(max_u, fabsf(f[(size_t)i * n + j]));
+            }
+        }
+        report->growth = max_a > 0 ? max_u / max_a : INFINITY;
+
+        // Hager's estimate of ||A^-1||_1
+        double inv_norm = 0;
+        for (int i = 0; i < n; i++)
+        {
+            x[i] = 1.0 / n;
+        }
+        for (int iter = 0; iter < 5; iter++)
+        {
+            mixedSolve(f, perm, n, x, y);
+            inv_norm = 0;
+            for (int i = 0; i < n; i++)
+            {
+                inv_norm += fabs(y[i]);
+                y[i] = y[i] >= 0 ? 1 : -1;
+            }
+            mixedSolveTransposed(f, perm, n, y, z, w);
+            int j_max = 0;
+            double ztx = 0;
+            for (int i = 0; i < n; i++)
+            {
+                ztx += z[i] * x[i];
+                if (fabs(z[i]) > fabs(z[j_max]))
+                {
+                    j_max = i;
+                }
+            }
+            if (fabs(z[j_max]) <= ztx)
+            {
+                break;
+            }
+            memset(x, 0, n * sizeof(double));
+            x[j_max] = 1;
+        }
+        report->cond = norm_a * inv_norm;
+
+        // Hutchinson probes of M = (LU)^-1 (PA - LU): tr(M) corrects ln|det|, and the
+        // spread plus ||M||_F^2 / 2 (the dropped second order term) bound the error
+        double sum = 0, sum_sq = 0, frob = 0;
+        unsigned long long state = 12345;
+        for (int probe = 0; probe < MIXED_PROBES; probe++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                z[i] = (state >> 63) ? 1.0 : -1.0;
+            }
+
+            // x = A z, then y = L U z, both in double
+            #pragma omp parallel for
+            for (int i = 0; i < n; i++)
+            {
+                double s = 0;
+                for (int j = 0; j < n; j++)
+                {
+                    s += arr[i][j] * z[j];
+                }
+                x[i] = s;
+            }
+            for (int i = 0; i < n; i++)
+            {
+                double s = 0;
+                const float *row = &f[(size_t)i * n];
+                for (int j = i; j < n; j++)
+                {
+                    s += row[j] * z[j];
+                }
+                w[i] = s;
+            }
+            for (int i = n - 1; i >= 0; i--)
+            {
+                double s = w[i];
+                const float *row = &f[(size_t)i * n];
+                for (int j = 0; j < i; j++)
+                {
+                    s += row[j] * w[j];
+                }
+                y[i] = s;
+            }
+
+            // Residual in original row order, so mixedSolve can apply P itself
+            for (int i = 0; i < n; i++)
+            {
+                x[perm[i]] -= y[i];
+            }
+            mixedSolve(f, perm, n, x, y);
+
+            double sample = 0, norm = 0;
+            for (int i = 0; i < n; i++)
+            {
+                sample += z[i] * y[i];
+                norm += y[i] * y[i];
+            }
+            sum += sample;
+            sum_sq += sample * sample;
+            frob += norm;
+        }
+        double mean = sum / MIXED_PROBES;
+        double var = fmax(sum_sq / MIXED_PROBES - mean * mean, 0) / (MIXED_PROBES - 1);
+        lndet += mean;
+        report->error = (sqrt(var) + frob / MIXED_PROBES / 2) / log(10.0);
+
+        report->used_float = report->growth < MIXED_MAX_GROWTH && report->cond * FLT_EPSILON < MIXED_MAX_COND_EPS && report->error < tol;
+    }
+
+    if (!report->used_float)
+    {
+        lndet = luLogDeterminant(arr, n, &sign);
+    }
+
+    arenaRelease(&workspace, mark);
+
+    if (sign == 0)
+    {
+        return lt ? -INFINITY : 0;
+    }
+    if (lt)
+    {
+        return lndet / log(10.0);
+    }
+    return sign * expl(lndet);
+}
+
+// C (m x k2) -= A (m x k) * B (k x k2), row-major with leading dimension lda. Halves the
+// largest dimension until the block is small; row and column halves are independent tasks.
+void rluGemm(double *c, const double *a, const double *b, int m, int k2, int k, int lda)
+{
+    long work = (long)m * k2 * k;
+    if (work <= RLU_BASE_WORK)
+    {
+        for (int i = 0; i < m; i++)
+        {
+            double *crow = &c[(size_t)i * lda];
+            for (int p = 0; p < k; p++)
+            {
+                double f = a[(size_t)i * lda + p];
+                const double *brow = &b[(size_t)p * lda];
+                #pragma omp simd
+                for (int j = 0; j < k2; j++)
+                {
+                    crow[j] -= f * brow[j];
+                }
+            }
+        }
+    }
+    else if (m >= k2 && m >= k)
+    {
+        int h = m / 2;
+        #pragma omp task if (work > RLU_TASK_WORK)
+        rluGemm(c, a, b, h, k2, k, lda);
+        rluGemm(&c[(size_t)h * lda], &a[(size_t)h * lda], b, m - h, k2, k, lda);
+        #pragma omp taskwait
+    }
+    else if (k2 >= k)
+    {
+        int h = k2 / 2;
+        #pragma omp task if (work > RLU_TASK_WORK)
+        rluGemm(c, a, b, m, h, k, lda);
+        rluGemm(&c[h], a, &b[h], m, k2 - h, k, lda);
+        #pragma omp taskwait
+    }
+    else
+    {
+        // Splitting the inner dimension makes both halves update C, so they run in order
+        int h = k / 2;
+        rluGemm(c, a, b, m, k2, h, lda);
+        rluGemm(c, &a[h], &b[(size_t)h * lda], m, k2, k - h, lda);
+    }
+}
+
+// B (m x k2) = L^-1 B for the unit lower triangular L (m x m), same layout as rluGemm
+void rluTrsm(const double *l, double *b, int m, int k2, int lda)
+{
+    if ((long)m * m * k2 <= RLU_BASE_WORK || m == 1)
+    {
+        for (int p = 0; p < m; p++)
+        {
+            const double *brow = &b[(size_t)p * lda];
+            for (int i = p + 1; i < m; i++)
+            {
+                double f = l[(size_t)i * lda + p];
+                double *irow = &b[(size_t)i * lda];
+                #pragma omp simd
+                for (int j = 0; j < k2; j++)
+                {
+                    irow[j] -= f * brow[j];
+                }
+            }
+        }
+    }
+    else if (k2 > m)
+    {
+        int h = k2 / 2;
+        #pragma omp task if ((long)m * m * k2 > RLU_TASK_WORK)
+        rluTrsm(l, b, m, h, lda);
+        rluTrsm(l, &b[h], m, k2 - h, lda);
+        #pragma omp taskwait
+    }
+    else
+    {
+        int h = m / 2;
+        rluTrsm(l, b, h, k2, lda);
+        rluGemm(&b[(size_t)h * lda], &l[(size_t)h * lda], b, m - h, k2, h, lda);
+        rluTrsm(&l[(size_t)h * lda + h], &b[(size_t)h * lda], m - h, k2, lda);
+    }
+}
+
+// Swap rows k and piv[k] for k in [k0, k1) over ncols columns starting at a
+void rluSwapRows(double *a, const int *piv, int k0, int k1, int ncols, int lda)
+{
+    for (int k = k0; k < k1; k++)
+    {
+        if (piv[k] != k)
+        {
+            double *r1 = &a[(size_t)k * lda];
+            double *r2 = &a[(size_t)piv[k] * lda];
+            for (int j = 0; j < ncols; j++)
+            {
+                double temp = r1[j];
+                r1[j] = r2[j];
+                r2[j] = temp;
+            }
+        }
+    }
+}
+
+// Recursive LU with partial pivoting of the m x n panel at a (m >= n): factor the left half of
+// the columns, update the right half, factor what is left of it, then swap the left half's rows
+// to match. piv[k] is the row (relative to the panel) swapped with row k.
+void rluFactor(double *a, int m, int n, int lda, int *piv, int *nswaps)
+{
+    if (n <= RLU_BASE)
+    {
+        for (int k = 0; k < n; k++)
+        {
+            int i_max = k;
+            for (int i = k; i < m; i++)
+            {
+                if (fabs(a[(size_t)i * lda + k]) > fabs(a[(size_t)i_max * lda + k]))
+                {
+                    i_max = i;
+                }
+            }
+            piv[k] = i_max;
+            if (i_max != k)
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    double temp = a[(size_t)k * lda + j];
+                    a[(size_t)k * lda + j] = a[(size_t)i_max * lda + j];
+                    a[(size_t)i_max * lda + j] = temp;
+                }
+                (*nswaps)++;
+            }
+
+            double pivot = a[(size_t)k * lda + k];
+            if (pivot == 0)
+            {
+                continue;
+            }
+            for (int i = k + 1; i < m; i++)
+            {
+                double *row = &a[(size_t)i * lda];
+                double factor = row[k] / pivot;
+                row[k] = factor;
+                for (int j = k + 1; j < n; j++)
+                {
+                    row[j] -= factor * a[(size_t)k * lda + j];
+                }
+            }
+        }
+        return;
+    }
+
+    int n1 = n / 2, n2 = n - n1;
+
+    rluFactor(a, m, n1, lda, piv, nswaps);
+    rluSwapRows(&a[n1], piv, 0, n1, n2, lda);
+    rluTrsm(a, &a[n1], n1, n2, lda);
+    rluGemm(&a[(size_t)n1 * lda + n1], &a[(size_t)n1 * lda], &a[n1], m - n1, n2, n1, lda);
+
+    rluFactor(&a[(size_t)n1 * lda + n1], m - n1, n2, lda, &piv[n1], nswaps);
+    for (int k = n1; k < n; k++)
+    {
+        piv[k] += n1;
+    }
+    rluSwapRows(a, piv, n1, n, n1, lda);
+}
+
+long double PLUDeterminantRecursive(double **arr, int n, bool lt, bool parallel)
+{
+    // Contiguous copy so the recursion can address sub-blocks with a leading dimension
+    int nswaps = 0;
+    size_t mark = arenaMark(&workspace);
+    double *a = arenaAlloc(&workspace, (size_t)n * n * sizeof(double));
+    int *piv = arenaAlloc(&workspace, n * sizeof(int));
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(&a[(size_t)i * n], arr[i], n * sizeof(double));
+    }
+
+    if (parallel)
+    {
+        #pragma omp parallel
+        #pragma omp single
+        rluFactor(a, n, n, n, piv, &nswaps);
+    }
+    else
+    {
+        rluFactor(a, n, n, n, piv, &nswaps);
+    }
+
+    long double det = lt ? 0 : 1;
+    for (int i = 0; i < n; i++)
+    {
+        if (lt)
+        {
+            det += log10(fabs(a[(size_t)i * n + i]));
+        }
+        else
+        {
+            det *= a[(size_t)i * n + i];
+        }
+    }
+
+    arenaRelease(&workspace, mark);
+
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
+    return det;
+}
+
+// Parse a sysfs cpulist such as "0-15,32-47" into cpus, keeping only CPUs in allowed
+int parseCpuList(const char *list, const cpu_set_t *allowed, int *cpus)
+{
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0' && *p != '\n')
+    {
+        char *end;
+        int lo = strtol(p, &end, 10), hi = lo;
+        if (*end == '-')
+        {
+            hi = strtol(end + 1, &end, 10);
+        }
+        for (int c = lo; c <= hi && count < NUMA_MAX_CPUS; c++)
+        {
+            if (CPU_ISSET(c, allowed))
+            {
+                cpus[count++] = c;
+            }
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p != ',')
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+// Read the NUMA nodes and their CPUs from sysfs; one node holding every allowed CPU if that fails
+void readTopology(void)
+{
+    cpu_set_t allowed;
+    char path[64], list[4096];
+
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    numa_nodes = 0;
+    for (int node = 0; node < NUMA_MAX_NODES; node++)
+    {
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            continue;
+        }
+        if (fgets(list, sizeof(list), file) != NULL)
+        {
+            int count = parseCpuList(list, &allowed, numa_cpus[numa_nodes]);
+            if (count > 0)
+            {
+                numa_ncpus[numa_nodes++] = count;
+            }
+        }
+        fclose(file);
+    }
+
+    if (numa_nodes == 0)
+    {
+        numa_ncpus[0] = 0;
+        for (int c = 0; c < CPU_SETSIZE && numa_ncpus[0] < NUMA_MAX_CPUS; c++)
+        {
+            if (CPU_ISSET(c, &allowed))
+            {
+                numa_cpus[0][numa_ncpus[0]++] = c;
+            }
+        }
+        numa_nodes = 1;
+    }
+}
+
+// Pin every thread of the current team to one CPU. close fills node 0 before node 1,
+// spread deals threads round robin over the nodes. Records each thread's node.
+void pinThreads(Binding binding)
+{
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int node = 0, index = t;
+
+        if (binding == BIND_SPREAD)
+        {
+            node = t % numa_nodes;
+            index = t / numa_nodes;
+        }
+        else if (binding == BIND_CLOSE)
+        {
+            int total = 0;
+            for (int i = 0; i < numa_nodes; i++)
+            {
+                total += numa_ncpus[i];
+            }
+            index = t % total;
+            while (index >= numa_ncpus[node])
+            {
+                index -= numa_ncpus[node++];
+            }
+        }
+
+        if (binding != BIND_NONE)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(numa_cpus[node][index % numa_ncpus[node]], &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        else
+        {
+            // Unpinned: attribute the thread to the node of the CPU it runs on now
+            int cpu = sched_getcpu();
+            for (int i = 0; i < numa_nodes; i++)
+            {
+                for (int j = 0; j < numa_ncpus[i]; j++)
+                {
+                    if (numa_cpus[i][j] == cpu)
+                    {
+                        node = i;
+                    }
+                }
+            }
+        }
+
+        if (t < NUMA_MAX_CPUS)
+        {
+            thread_node[t] = node;
+        }
+    }
+}
+
+// STREAM triad on arrays first touched by each thread, summed per node
+void reportNodeBandwidth(void)
+{
+    double node_bw[NUMA_MAX_NODES] = {0};
+    int node_threads[NUMA_MAX_NODES] = {0};
+
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        size_t len = NUMA_STREAM_DOUBLES;
+        double *x = malloc(len * sizeof(double));
+        double *y = malloc(len * sizeof(double));
+        double *z = malloc(len * sizeof(double));
+        for (size_t i = 0; i < len; i++)
+        {
+            x[i] = 0;
+            y[i] = 1;
+            z[i] = 2;
+        }
+
+        double best = 1e30;
+        for (int rep = 0; rep < 5; rep++)
+        {
+            #pragma omp barrier
+            double start = omp_get_wtime();
+            #pragma omp simd
+            for (size_t i = 0; i < len; i++)
+            {
+                x[i] = y[i] + 3.0 * z[i];
+            }
+            best = fmin(best, omp_get_wtime() - start);
+        }
+
+        int node = t < NUMA_MAX_CPUS ? thread_node[t] : 0;
+        #pragma omp critical
+        {
+            node_bw[node] += 3.0 * len * sizeof(double) / best / 1e9;
+            stream_sink += x[len - 1];
+            node_threads[node]++;
+        }
+
+        free(x);
+        free(y);
+        free(z);
+    }
+
+    for (int node = 0; node < numa_nodes; node++)
+    {
+        if (node_threads[node] > 0)
+        {
+            printf("(0) Node %d: %d threads, triad %.1f GB/s\n", node, node_threads[node], node_bw[node]);
+        }
+    }
+}
+
+// Gaussian elimination with partial pivoting on the panel columns [k, k + b) of the m rows
+// listed in rows (by original index); writes the chosen pivot rows to winners, returns how many
+int selectPivotRows(double **a, const int *pos, const int *rows, int m, int k, int b, int *winners, double *work)
+{
+    int count = m < b ? m : b;
+    int ids[2 * CALU_PANEL];
+
+    for (int i = 0; i < m; i++)
+    {
+        memcpy(&work[i * b], &a[pos[rows[i]]][k], b * sizeof(double));
+        ids[i] = rows[i];
+    }
+
+    for (int j = 0; j < count; j++)
+    {
+        int i_max = j;
+        for (int i = j; i < m; i++)
+        {
+            if (fabs(work[i * b + j]) > fabs(work[i_max * b + j]))
+            {
+                i_max = i;
+            }
+        }
+        if (i_max != j)
+        {
+            for (int c = 0; c < b; c++)
+            {
+                double temp = work[j * b + c];
+                work[j * b + c] = work[i_max * b + c];
+                work[i_max * b + c] = temp;
+            }
+            int temp = ids[j];
+            ids[j] = ids[i_max];
+            ids[i_max] = temp;
+        }
+        winners[j] = ids[j];
+
+        double pivot = work[j * b + j];
+        if (pivot == 0)
+        {
+            continue;
+        }
+        for (int i = j + 1; i < m; i++)
+        {
+            double factor = work[i * b + j] / pivot;
+            for (int c = j + 1; c < b; c++)
+            {
+                work[i * b + c] -= factor * work[j * b + c];
+            }
+        }
+    }
+    return count;
+}
+
+long double PLUDeterminantCALU(double **arr, int n, bool lt)
+{
+    // Copy array into the workspace so arr doesn't get modified. Rows are moved by swapping
+    // pointers; rowid/pos map between positions and original row numbers.
+    size_t mark = arenaMark(&workspace);
+    int nswaps = 0;
+    int nthreads = omp_get_max_threads();
+    double **a = workspaceCopy(arr, n);
+    int *rowid = arenaAlloc(&workspace, n * sizeof(int));
+    int *pos = arenaAlloc(&workspace, n * sizeof(int));
+    int *cand = arenaAlloc(&workspace, (size_t)nthreads * CALU_PANEL * sizeof(int));
+    int *ncand = arenaAlloc(&workspace, nthreads * sizeof(int));
+    double *work = arenaAlloc(&workspace, (size_t)nthreads * 2 * CALU_PANEL * CALU_PANEL * sizeof(double));
+
+    for (int i = 0; i < n; i++)
+    {
+        rowid[i] = i;
+        pos[i] = i;
+    }
+
+    for (int k = 0; k < n; k += CALU_PANEL)
+    {
+        int b = n - k < CALU_PANEL ? n - k : CALU_PANEL;
+        int m = n - k;
+
+        // Tournament, leaves: every block of at least b rows picks b candidates by GEPP
+        int blocks = m / b < nthreads ? m / b : nthreads;
+        if (blocks < 1)
+        {
+            blocks = 1;
+        }
+        #pragma omp parallel for
+        for (int t = 0; t < blocks; t++)
+        {
+            int lo = k + (int)((long)m * t / blocks);
+            int hi = k + (int)((long)m * (t + 1) / blocks);
+            double *w = &work[(size_t)t * 2 * CALU_PANEL * CALU_PANEL];
+            int best[CALU_PANEL];
+            int got = 0;
+
+            // Walk the block in chunks of b rows, carrying the current candidates along
+            for (int start = lo; start < hi; start += b)
+            {
+                int rows[2 * CALU_PANEL], count = 0;
+                for (int i = 0; i < got; i++)
+                {
+                    rows[count++] = best[i];
+                }
+                for (int i = start; i < hi && i < start + b; i++)
+                {
+                    rows[count++] = rowid[i];
+                }
+                got = selectPivotRows(a, pos, rows, count, k, b, best, w);
+            }
+            memcpy(&cand[t * CALU_PANEL], best, got * sizeof(int));
+            ncand[t] = got;
+        }
+
+        // Reduction tree: pairs of candidate sets play off until one set of b winners is left
+        for (int stride = 1; stride < blocks; stride *= 2)
+        {
+            #pragma omp parallel for
+            for (int t = 0; t < blocks - stride; t += 2 * stride)
+            {
+                int rows[2 * CALU_PANEL], count = 0;
+                for (int i = 0; i < ncand[t]; i++)
+                {
+                    rows[count++] = cand[t * CALU_PANEL + i];
+                }
+                for (int i = 0; i < ncand[t + stride]; i++)
+                {
+                    rows[count++] = cand[(t + stride) * CALU_PANEL + i];
+                }
+                ncand[t] = selectPivotRows(a, pos, rows, count, k, b, &cand[t * CALU_PANEL], &work[(size_t)omp_get_thread_num() * 2 * CALU_PANEL * CALU_PANEL]);
+            }
+        }
+
+        // Move the winners to the top of the panel (pointer swaps only)
+        for (int j = 0; j < ncand[0]; j++)
+        {
+            int p = pos[cand[j]];
+            if (p != k + j)
+            {
+                double *temp = a[k + j];
+                a[k + j] = a[p];
+                a[p] = temp;
+                int id = rowid[k + j];
+                rowid[k + j] = rowid[p];
+                rowid[p] = id;
+                pos[rowid[k + j]] = k + j;
+                pos[rowid[p]] = p;
+                nswaps++;
+            }
+        }
+
+        // Factor the panel without further pivoting and bring its top rows up to date
+        for (int j = k; j < k + b; j++)
+        {
+            double pivot = a[j][j];
+            if (pivot == 0)
+            {
+                continue;
+            }
+            #pragma omp parallel for schedule(static)
+            for (int i = j + 1; i < n; i++)
+            {
+                double factor = a[i][j] / pivot;
+                a[i][j] = factor;
+                int end = i < k + b ? n : k + b;
+                for (int c = j + 1; c < end; c++)
+                {
+                    a[i][c] -= factor * a[j][c];
+                }
+            }
+        }
+
+        // Rank-b update of the trailing matrix, one parallel region per panel
+        #pragma omp parallel for schedule(static)
+        for (int i = k + b; i < n; i++)
+        {
+            double *row = a[i];
+            for (int j = k; j < k + b; j++)
+            {
+                double factor = row[j];
+                const double *prow = a[j];
+                #pragma omp simd
+                for (int c = k + b; c < n; c++)
+                {
+                    row[c] -= factor * prow[c];
+                }
+            }
+        }
+    }
+
+    long double det = lt ? 0 : 1;
+    for (int i = 0; i < n; i++)
+    {
+        if (lt)
+        {
+            det += log10(fabs(a[i][i]));
+        }
+        else
+        {
+            det *= a[i][i];
+        }
+    }
+
+    arenaRelease(&workspace, mark);
+
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
+    return det;
+}
+
+// Right-looking blocked LU on a contiguous copy. Each LU_BLOCK wide panel is factored with
+// partial pivoting (whole rows are swapped), the U row block beside it is solved with the unit
+// lower panel, and the trailing matrix takes the rank-LU_BLOCK update in a single gemm call
+long double PLUDeterminantBlocked(double **arr, int n, bool lt)
+{
+    int nswaps = 0;
+    size_t mark = arenaMark(&workspace);
+    double *a = arenaAlloc(&workspace, (size_t)n * n * sizeof(double));
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(a + (size_t)i * n, arr[i], n * sizeof(double));
+    }
+
+    for (int k0 = 0; k0 < n; k0 += LU_BLOCK)
+    {
+        int k1 = n - k0 < LU_BLOCK ? n : k0 + LU_BLOCK;
+
+        // Panel
+        for (int j = k0; j < k1; j++)
+        {
+            int i_max = j;
+            for (int i = j + 1; i < n; i++)
+            {
+                if (fabs(a[(size_t)i * n + j]) > fabs(a[(size_t)i_max * n + j]))
+                {
+                    i_max = i;
+                }
+            }
+            if (i_max != j)
+            {
+                double *x = a + (size_t)j * n, *y = a + (size_t)i_max * n;
+                for (int c = 0; c < n; c++)
+                {
+                    double temp = x[c];
+                    x[c] = y[c];
+                    y[c] = temp;
+                }
+                nswaps++;
+            }
+
+            const double *prow = a + (size_t)j * n;
+            if (prow[j] == 0)
+            {
+                continue;
+            }
+            #pragma omp parallel for schedule(static) if ((long)(n - j) * (k1 - j) > 16384)
+            for (int i = j + 1; i < n; i++)
+            {
+                double *row = a + (size_t)i * n;
+                double factor = row[j] / prow[j];
+                row[j] = factor;
+                for (int c = j + 1; c < k1; c++)
+                {
+                    row[c] -= factor * prow[c];
+                }
+            }
+        }
+
+        if (k1 == n)
+        {
+            break;
+        }
+
+        // U row block, solved in column stripes
+        #pragma omp parallel for schedule(static)
+        for (int c0 = k1; c0 < n; c0 += 256)
+        {
+            int c1 = n - c0 < 256 ? n : c0 + 256;
+            for (int i = k0 + 1; i < k1; i++)
+            {
+                double *row = a + (size_t)i * n;
+                for (int j = k0; j < i; j++)
+                {
+                    double factor = row[j];
+                    const double *urow = a + (size_t)j * n;
+                    for (int c = c0; c < c1; c++)
+                    {
+                        row[c] -= factor * urow[c];
+                    }
+                }
+            }
+        }
+
+        // Trailing update: A22 -= L21 * U12
+        gemm(n - k1, n - k1, k1 - k0, -1.0, a + (size_t)k1 * n + k0, n, a + (size_t)k0 * n + k1, n, 1.0, a + (size_t)k1 * n + k1, n);
+    }
+
+    long double det = lt ? 0 : 1;
+    for (int i = 0; i < n; i++)
+    {
+        if (lt)
+        {
+            det += log10(fabs(a[(size_t)i * n + i]));
+        }
+        else
+        {
+            det *= a[(size_t)i * n + i];
+        }
+    }
+    arenaRelease(&workspace, mark);
+
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
+    return det;
+}
+
+// Wait at a sense-reversing barrier. Each thread flips its own sense; the last to arrive
+// resets the count and publishes the new sense, the others spin until they see it
+void spinBarrierWait(SpinBarrier *b, int *local_sense)
+{
+    *local_sense = !*local_sense;
+    if (__atomic_sub_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        __atomic_store_n(&b->count, b->threads, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->sense, *local_sense, __ATOMIC_RELEASE);
+        return;
+    }
+    int spins = 0;
+    while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) != *local_sense)
+    {
+        if (++spins >= b->spin_limit)
+        {
+            sched_yield();
+            spins = 0;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+// The OMP elimination with the threads kept in one parallel region for the whole
+// factorization instead of forking a team for every column. Thread t owns rows i % T == t,
+// copies them in and alone updates them. Each step is: search the owned rows for the
+// pivot candidate, barrier, every thread picks the same pivot from the candidates and swaps
+// its share of the columns of rows k and i_max, barrier, eliminate the owned rows
+long double PLUDeterminantPool(double **arr, int n, bool lt, PoolReport *report)
+{
+    size_t mark = arenaMark(&workspace);
+    int nthreads = omp_get_max_threads();
+    // Row i is copied by thread i % T, its owner below
+    double **a = workspaceCopy(arr, n);
+    int nswaps = 0;
+
+    // One cache line per thread for its pivot candidate
+    typedef struct
+    {
+        double value;
+        int row;
+        char pad[CACHE_LINE - sizeof(double) - sizeof(int)];
+    } Candidate;
+    Candidate *candidates = arenaAlloc(&workspace, nthreads * sizeof(Candidate));
+    double *waits = arenaAlloc(&workspace, nthreads * CACHE_LINE);
+
+    SpinBarrier barrier;
+    barrier.count = nthreads;
+    barrier.sense = 0;
+    barrier.threads = nthreads;
+    barrier.spin_limit = nthreads <= sysconf(_SC_NPROCESSORS_ONLN) ? POOL_SPIN_LIMIT : 1;
+
+    double start = omp_get_wtime();
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        int local_sense = 0;
+        double waited = 0;
+
+        // Columns of the pivot row swap done by this thread
+        int j0 = (int)((long)n * t / nthreads);
+        int j1 = (int)((long)n * (t + 1) / nthreads);
+
+        double w = omp_get_wtime();
+        spinBarrierWait(&barrier, &local_sense);
+        waited += omp_get_wtime() - w;
+
+        for (int k = 0; k < n; k++)
+        {
+            // The first owned row at or below k
+            int first = k + (t - k % nthreads + nthreads) % nthreads;
+            int best = -1;
+            double best_value = -1;
+            for (int i = first; i < n; i += nthreads)
+            {
+                if (fabs(a[i][k]) > best_value)
+                {
+                    best_value = fabs(a[i][k]);
+                    best = i;
+                }
+            }
+            candidates[t].value = best_value;
+            candidates[t].row = best;
+
+            w = omp_get_wtime();
+            spinBarrierWait(&barrier, &local_sense);
+            waited += omp_get_wtime() - w;
+
+            // Same choice on every thread: largest value, lowest row on ties, as the serial scan.
+            // Only the candidates are read here, rows k and i_max may already be being swapped
+            int i_max = k;
+            double max_value = -1;
+            for (int c = 0; c < nthreads; c++)
+            {
+                if (candidates[c].row >= 0 &&
+                    (candidates[c].value > max_value || (candidates[c].value == max_value && candidates[c].row < i_max)))
+                {
+                    max_value = candidates[c].value;
+                    i_max = candidates[c].row;
+                }
+            }
+            if (i_max != k)
+            {
+                for (int j = j0; j < j1; j++)
+                {
+                    double temp = a[k][j];
+                    a[k][j] = a[i_max][j];
+                    a[i_max][j] = temp;
+                }
+                if (t == 0)
+                {
+                    nswaps++;
+                }
+            }
+
+            w = omp_get_wtime();
+            spinBarrierWait(&barrier, &local_sense);
+            waited += omp_get_wtime() - w;
+
+            const double *pivot = a[k];
+            for (int i = first; i < n; i += nthreads)
+            {
+                if (i == k)
+                {
+                    continue;
+                }
+                double *row = a[i];
+                double factor = row[k] / pivot[k];
+                #pragma omp simd
+                for (int j = k + 1; j < n; j++)
+                {
+                    row[j] -= factor * pivot[j];
+                }
+                row[k] = factor;
+            }
+        }
+        waits[t * (CACHE_LINE / sizeof(double))] = waited;
+    }
+    double elapsed = omp_get_wtime() - start;
+
+    report->barriers = 2L * n + 1;
+    report->elapsed = elapsed;
+    report->wait_total = 0;
+    report->wait_max = 0;
+    for (int t = 0; t < nthreads; t++)
+    {
+        double waited = waits[t * (CACHE_LINE / sizeof(double))];
+        report->wait_total += waited;
+        report->wait_max = waited > report->wait_max ? waited : report->wait_max;
+    }
+
+    // Determinant should just be the product of the diagonal now
+    long double det = lt ? 0 : 1;
+    for (int i = 0; i < n; i++)
+    {
+        if (lt)
+        {
+            det += log10(fabs(a[i][i]));
+        }
+        else
+        {
+            det *= a[i][i];
+        }
+    }
+    arenaRelease(&workspace, mark);
+
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
+    return det;
+}
+
+// Lower and upper bandwidth and nonzero count of the loaded matrix
+void matrixShape(double **a, int n, MatrixShape *shape)
+{
+    int kl = 0;
+    int ku = 0;
+    long nnz = 0;
+    #pragma omp parallel for schedule(static) reduction(max : kl, ku) reduction(+ : nnz)
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            if (a[i][j] != 0)
+            {
+                nnz++;
+                if (i - j > kl)
+                {
+                    kl = i - j;
+                }
+                if (j - i > ku)
+                {
+                    ku = j - i;
+                }
+            }
+        }
+    }
+    shape->kl = kl;
+    shape->ku = ku;
+    shape->nnz = nnz;
+}
+
+// Banded LU when the band is narrow, sparse LU when few entries are nonzero, dense otherwise
+Method chooseMethod(const MatrixShape *shape, int n)
+{
+    if ((long)(shape->kl + shape->ku + 1) * BANDED_MAX_FRACTION <= n)
+    {
+        return METHOD_BANDED;
+    }
+    if (shape->nnz <= SPARSE_MAX_DENSITY * n * n)
+    {
+        return METHOD_SPARSE;
+    }
+    return METHOD_OMP;
+}
+
+// Banded LU with partial pivoting, O(n * kl * (kl + ku)). Row i keeps columns i - kl to
+// i + kl + ku, since row swaps widen the upper band of U by kl
+long double PLUDeterminantBanded(double **arr, int n, int kl, int ku, bool lt)
+{
+    int w = 2 * kl + ku + 1;
+    int nswaps = 0;
+    size_t mark = arenaMark(&workspace);
+    double *ab = arenaCalloc(&workspace, (size_t)n * w * sizeof(double));
+// Column j of row i
+#define BAND(i, j) ab[(size_t)(i) * w + (j) - (i) + kl]
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        int j0 = i - kl < 0 ? 0 : i - kl;
+        int j1 = i + ku < n ? i + ku : n - 1;
+        for (int j = j0; j <= j1; j++)
+        {
+            BAND(i, j) = arr[i][j];
+        }
+    }
+
+    long double det = lt ? 0 : 1;
+    for (int k = 0; k < n; k++)
+    {
+        int last = k + kl < n ? k + kl : n - 1;
+        int right = k + kl + ku < n ? k + kl + ku : n - 1;
+
+        // pivot
+        int i_max = k;
+        for (int i = k + 1; i <= last; i++)
+        {
+            if (fabs(BAND(i, k)) > fabs(BAND(i_max, k)))
+            {
+                i_max = i;
+            }
+        }
+        if (i_max != k)
+        {
+            for (int j = k; j <= right; j++)
+            {
+                double temp = BAND(k, j);
+                BAND(k, j) = BAND(i_max, j);
+                BAND(i_max, j) = temp;
+            }
+            nswaps++;
+        }
+
+        double pivot = BAND(k, k);
+        if (lt)
+        {
+            det += log10(fabs(pivot));
+        }
+        else
+        {
+            det *= pivot;
+        }
+        if (pivot == 0)
+        {
+            continue;
+        }
+
+        // elimination of the at most kl rows below the pivot
+        #pragma omp parallel for schedule(static) if ((long)(last - k) * (right - k) > BANDED_PARALLEL_WORK)
+        for (int i = k + 1; i <= last; i++)
+        {
+            double factor = BAND(i, k) / pivot;
+            for (int j = k + 1; j <= right; j++)
+            {
+                BAND(i, j) -= factor * BAND(k, j);
+            }
+            BAND(i, k) = factor;
+        }
+    }
+#undef BAND
+
+    arenaRelease(&workspace, mark);
+    if (!lt && nswaps % 2 != 0)
+    {
+        det *= -1;
+    }
+    return det;
+}
+
+// Minimum degree ordering of the graph of A + A^T. Eliminating a vertex joins its remaining
+// neighbours into a clique; adjacency is kept as bitsets so each join is a row of word ORs
+void minimumDegreeOrder(const SparseMatrix *A, int *q)
+{
+    int n = A->n;
+    int words = (n + 63) / 64;
+    uint64_t *adj = calloc((size_t)n * words, sizeof(uint64_t));
+    uint64_t *alive = malloc(words * sizeof(uint64_t));
+    int *degree = malloc(n * sizeof(int));
+    int *nbrs = malloc(n * sizeof(int));
+
+    for (int j = 0; j < n; j++)
+    {
+        for (int p = A->p[j]; p < A->p[j + 1]; p++)
+        {
+            int i = A->i[p];
+            if (i != j)
+            {
+                adj[(size_t)i * words + j / 64] |= 1ULL << (j % 64);
+                adj[(size_t)j * words + i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+    for (int w = 0; w < words; w++)
+    {
+        alive[w] = ~0ULL;
+    }
+    if (n % 64 != 0)
+    {
+        alive[words - 1] = (1ULL << (n % 64)) - 1;
+    }
+    for (int v = 0; v < n; v++)
+    {
+        degree[v] = 0;
+        for (int w = 0; w < words; w++)
+        {
+            degree[v] += __builtin_popcountll(adj[(size_t)v * words + w]);
+        }
+    }
+
+    for (int k = 0; k < n; k++)
+    {
+        int v = -1;
+        for (int u = 0; u < n; u++)
+        {
+            if ((alive[u / 64] >> (u % 64) & 1) && (v < 0 || degree[u] < degree[v]))
+            {
+                v = u;
+            }
+        }
+        q[k] = v;
+        alive[v / 64] &= ~(1ULL << (v % 64));
+
+        const uint64_t *av = adj + (size_t)v * words;
+        int count = 0;
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t bits = av[w] & alive[w];
+            while (bits)
+            {
+                nbrs[count++] = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+            }
+        }
+
+        #pragma omp parallel for schedule(static) if ((long)count * words > 4096)
+        for (int c = 0; c < count; c++)
+        {
+            int u = nbrs[c];
+            uint64_t *au = adj + (size_t)u * words;
+            int d = 0;
+            for (int w = 0; w < words; w++)
+            {
+                au[w] = (au[w] | av[w]) & alive[w];
+                d += __builtin_popcountll(au[w]);
+            }
+            au[u / 64] &= ~(1ULL << (u % 64));
+            degree[u] = d - 1;
+        }
+    }
+
+    free(adj);
+    free(alive);
+    free(degree);
+    free(nbrs);
+}
+
+// Depth-first search from row j through the columns of L already factored; finished rows are
+// pushed onto xi[top..n) in topological order
+int sparseReach(const int *lp, const int *li, int j, int top, int *xi, int *pstack, int *mark, int stamp, const int *pinv)
+{
+    int head = 0;
+    xi[0] = j;
+    while (head >= 0)
+    {
+        j = xi[head];
+        int jnew = pinv[j];
+        if (mark[j] != stamp)
+        {
+            mark[j] = stamp;
+            pstack[head] = jnew < 0 ? 0 : lp[jnew];
+        }
+        bool done = true;
+        int p2 = jnew < 0 ? 0 : lp[jnew + 1];
+        for (int p = pstack[head]; p < p2; p++)
+        {
+            int i = li[p];
+            if (mark[i] == stamp)
+            {
+                continue;
+            }
+            pstack[head] = p;
+            xi[++head] = i;
+            done = false;
+            break;
+        }
+        if (done)
+        {
+            head--;
+            xi[--top] = j;
+        }
+    }
+    return top;
+}
+
+// Parity of a permutation, counted from its cycles
+int permutationParity(const int *perm, int n)
+{
+    bool *seen = calloc(n, sizeof(bool));
+    int parity = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (seen[i])
+        {
+            continue;
+        }
+        int length = 0;
+        for (int j = i; !seen[j]; j = perm[j])
+        {
+            seen[j] = true;
+            length++;
+        }
+        parity ^= (length - 1) & 1;
+    }
+    free(seen);
+    return parity;
+}
+
+// Left-looking sparse LU (Gilbert-Peierls) on the columns in minimum degree order. Each column
+// is solved against the finished part of L through its reach, so work follows the nonzeros of
+// the factors rather than n^3. The determinant is the product of U's diagonal and the signs of
+// the row and column permutations
+long double PLUDeterminantSparse(double **arr, int n, bool lt)
+{
+    SparseMatrix A;
+    A.n = n;
+    A.p = malloc((n + 1) * sizeof(int));
+    int *counts = calloc(n, sizeof(int));
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            if (arr[i][j] != 0)
+            {
+                counts[j]++;
+            }
+        }
+    }
+    A.p[0] = 0;
+    for (int j = 0; j < n; j++)
+    {
+        A.p[j + 1] = A.p[j] + counts[j];
+        counts[j] = A.p[j];
+    }
+    A.i = malloc((A.p[n] + 1) * sizeof(int));
+    A.x = malloc((A.p[n] + 1) * sizeof(double));
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            if (arr[i][j] != 0)
+            {
+                A.i[counts[j]] = i;
+                A.x[counts[j]++] = arr[i][j];
+            }
+        }
+    }
+    free(counts);
+
+    int *q = malloc(n * sizeof(int));
+    minimumDegreeOrder(&A, q);
+
+    long cap = 4L * A.p[n] + n;
+    int *lp = malloc((n + 1) * sizeof(int));
+    int *li = malloc(cap * sizeof(int));
+    double *lx = malloc(cap * sizeof(double));
+    int *pinv = malloc(n * sizeof(int));
+    int *xi = malloc(2 * n * sizeof(int));
+    int *mark = malloc(n * sizeof(int));
+    double *x = calloc(n, sizeof(double));
+    long lnz = 0;
+    for (int i = 0; i < n; i++)
+    {
+        pinv[i] = -1;
+        mark[i] = -1;
+    }
+
+    long double det = lt ? 0 : 1;
+    bool singular = false;
+    for (int k = 0; k < n && !singular; k++)
+    {
+        lp[k] = lnz;
+        if (lnz + n > cap)
+        {
+            cap = 2 * cap + n;
+            li = realloc(li, cap * sizeof(int));
+            lx = realloc(lx, cap * sizeof(double));
+        }
+
+        // x = L \ A(:, q[k]) over the reach of the column's nonzeros
+        int col = q[k];
+        int top = n;
+        for (int p = A.p[col]; p < A.p[col + 1]; p++)
+        {
+            if (mark[A.i[p]] != k)
+            {
+                top = sparseReach(lp, li, A.i[p], top, xi, xi + n, mark, k, pinv);
+            }
+        }
+        for (int p = A.p[col]; p < A.p[col + 1]; p++)
+        {
+            x[A.i[p]] = A.x[p];
+        }
+        for (int px = top; px < n; px++)
+        {
+            int j = xi[px];
+            int J = pinv[j];
+            if (J < 0)
+            {
+                continue;
+            }
+            for (int p = lp[J] + 1; p < lp[J + 1]; p++)
+            {
+                x[li[p]] -= lx[p] * x[j];
+            }
+        }
+
+        // pivot: largest unpivoted row, keeping the diagonal when it is close enough
+        int ipiv = -1;
+        double best = -1;
+        for (int px = top; px < n; px++)
+        {
+            int i = xi[px];
+            if (pinv[i] < 0 && fabs(x[i]) > best)
+            {
+                best = fabs(x[i]);
+                ipiv = i;
+            }
+        }
+        if (ipiv < 0 || best == 0)
+        {
+            singular = true;
+            break;
+        }
+        if (pinv[col] < 0 && mark[col] == k && fabs(x[col]) >= SPARSE_PIVOT_TOL * best)
+        {
+            ipiv = col;
+        }
+
+        double pivot = x[ipiv];
+        if (lt)
+        {
+            det += log10(fabs(pivot));
+        }
+        else
+        {
+            det *= pivot;
+        }
+        pinv[ipiv] = k;
+        li[lnz] = ipiv;
+        lx[lnz++] = 1;
+        for (int px = top; px < n; px++)
+        {
+            int i = xi[px];
+            if (pinv[i] < 0)
+            {
+                li[lnz] = i;
+                lx[lnz++] = x[i] / pivot;
+            }
+            x[i] = 0;
+        }
+        lp[k + 1] = lnz;
+    }
+
+    if (singular)
+    {
+        det = lt ? -INFINITY : 0;
+    }
+    else if (!lt && permutationParity(pinv, n) != permutationParity(q, n))
+    {
+        det *= -1;
+    }
+
+    free(A.p);
+    free(A.i);
+    free(A.x);
+    free(q);
+    free(lp);
+    free(li);
+    free(lx);
+    free(pinv);
+    free(xi);
+    free(mark);
+    free(x);
+    return det;
+}
@@ -1,9 +1,11 @@
 /**
- * @file matrixvector.c
+ * @file serialmatrix.c
  * @authors Camp Steiner, Jeff Luong
  *
- * Compile:  gcc -Wall -g -o serialmatrix.o serialmatrix.c -fopenmp -std=c99 =lm
+ * Compile:  gcc -Wall -g -o serialmatrix.o serialmatrix.c matfile.c matstream.c -fopenmp -std=c99 -lm -lpthread
  * Usage: ./serialmatrix.o
+ *        A reader thread loads matrix i + 1 into the second of two buffers while matrix i is
+ *        factored, so at most two matrices are in memory
  */
 #include <stdlib.h>
 #include <stdio.h>
@@ -12,6 +14,7 @@
 #include <omp.h>
 #include <math.h>
 #include <stdbool.h>
+#include "matstream.h"
 
 // Function headers
 long double PLUDeterminantSerial(double **a, int n, bool lt);
@@ -25,31 +28,28 @@ int main(int argc, char *argv[])
 
     printf("===SERIAL RUN===\n\n");
 
+    // Two buffers of the largest matrix present
+    MatrixStream stream;
+    matrixStreamInit(&stream, matrixLargest(sizes, 14, false));
+    double sweep_start = omp_get_wtime();
+    matrixStreamStart(&stream, sizes, 14, false);
+
     for (int i = 0; i < 14; i++)
     {
         int arraySize = sizes[i];
 
-        double **a = malloc(arraySize * sizeof(double));
         // Create filename
-        sprintf(f_name, "input-matrix/m%04dx%04d.bin", arraySize, arraySize);
-        // sprintf(f_name, "input-matrix/m0256x0256.bin");
+        matrixPath(f_name, arraySize, false);
         printf("\n(1) Reading array file %s\n", f_name);
         printf("(2) Size %dx%d\n", arraySize, arraySize);
-        // Open file
-        FILE *datafile = fopen(f_name, "rb");
-        // Read elelements
-        for (int i = 0; i < arraySize; i++)
+        // Read on the reader thread while the previous matrix was being factored
+        double **a = matrixAcquire(&stream, i);
+        if (a == NULL)
         {
-            a[i] = (double *)malloc(arraySize * sizeof(double));
-            for (int j = 0; j < arraySize; j++)
-            {
-                fread(&a[i][j], sizeof(double), 1, datafile);
-                // printf("%f,", a[i][j]);
-            }
-            // printf("\n");
+            printf("Error reading %s.\n", f_name);
+            matrixRelease(&stream, i);
+            continue;
         }
-        // printf("Matrix has been read.\n");
-        fclose(datafile);
 
         double start, end;
 
@@ -61,7 +61,7 @@ int main(int argc, char *argv[])
         start = omp_get_wtime();
         long double det10 = PLUDeterminantSerial(a, arraySize, true);
         end = omp_get_wtime();
-        printf("(4) Log10 Determinant: %.6Le in %fs\n", det10, (end - start));
+        printf("(4) Log10 |Determinant|: %.6Le in %fs\n", det10, (end - start));
 
         // FILE *f = fopen("out.csv", "w");
         // if (f == NULL)
@@ -82,8 +82,14 @@ int main(int argc, char *argv[])
 
         // // close the file
         // fclose(f);
+
+        matrixRelease(&stream, i);
     }
 
+    matrixStreamJoin(&stream);
+    printf("\n===%d matrices in %fs, %fs of it waiting for reads===\n", stream.count, omp_get_wtime() - sweep_start, stream.wait_time);
+    matrixStreamFree(&stream);
+
     return 0;
 }
 
@@ -142,13 +148,13 @@ long double PLUDeterminantSerial(double **arr, int n, bool lt)
     //     printf("\n");
     // }
 
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
+    // Determinant should just be the product of the diagonal now, or the sum of its log10s
+    long double det = lt ? 0 : 1;
     for (int i = 0; i < n; i++)
     {
         if (lt)
         {
-            det *= log10(fabs(a[i][i]));
+            det += log10(fabs(a[i][i]));
         }
         else
         {
@@ -160,6 +166,12 @@ long double PLUDeterminantSerial(double **arr, int n, bool lt)
     { // parity for permutations I think?
         det *= -1;
     }
+
+    for (int i = 0; i < n; i++)
+    {
+        free(a[i]);
+    }
+    free(a);
     return det;
 }
 
@@ -219,13 +231,13 @@ long double PLUDeterminantOMP(double **arr, int n, bool lt)
     //     printf("\n");
     // }
 
-    // Determinant should just be the product of the diagonal now
-    long double det = 1;
+    // Determinant should just be the product of the diagonal now, or the sum of its log10s
+    long double det = lt ? 0 : 1;
     for (int i = 0; i < n; i++)
     {
         if (lt)
         {
-            det *= log10(fabs(a[i][i]));
+            det += log10(fabs(a[i][i]));
         }
         else
         {
@@ -237,5 +249,11 @@ long double PLUDeterminantOMP(double **arr, int n, bool lt)
     { // parity for permutations I think?
         det *= -1;
     }
+
+    for (int i = 0; i < n; i++)
+    {
+        free(a[i]);
+    }
+    free(a);
     return det;
 }
\ No newline at end of file
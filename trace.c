@@ -0,0 +1,119 @@
+/**
+ * @file trace.c
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Timeline tracing, see trace.h.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "trace.h"
+
+TraceRing *trace_rings = NULL;
+int trace_threads = 0;
+static double trace_origin;
+
+void traceInit(int threads)
+{
+    // Regions that do not set a team size run on omp_get_max_threads threads
+    if (omp_get_max_threads() > threads)
+    {
+        threads = omp_get_max_threads();
+    }
+    trace_rings = calloc(threads, sizeof(TraceRing));
+    for (int t = 0; t < threads; t++)
+    {
+        trace_rings[t].events = malloc(TRACE_EVENTS * sizeof(TraceEvent));
+    }
+    trace_threads = threads;
+    trace_origin = omp_get_wtime();
+}
+
+void traceAdd(const char *name, double seconds)
+{
+    if (trace_rings == NULL)
+        return;
+    int t = omp_get_thread_num();
+    if (t >= trace_threads)
+        return;
+    TraceCounter *counters = trace_rings[t].counters;
+    for (int c = 0; c < TRACE_COUNTERS; c++)
+    {
+        if (counters[c].name == NULL)
+            counters[c].name = name;
+        if (counters[c].name == name)
+        {
+            counters[c].seconds += seconds;
+            counters[c].calls++;
+            return;
+        }
+    }
+}
+
+// Write one event as a complete event: start and duration in microseconds
+static void writeEvent(FILE *file, const TraceEvent *event, int t)
+{
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event->name, t,
+            (event->start - trace_origin) * 1e6, (event->end - event->start) * 1e6);
+}
+
+long traceWrite(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL || trace_rings == NULL)
+    {
+        if (file != NULL)
+            fclose(file);
+        return -1;
+    }
+
+    long written = 0;
+    double now = omp_get_wtime();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"tsp\"}}");
+    for (int t = 0; t < trace_threads; t++)
+    {
+        TraceRing *ring = &trace_rings[t];
+        if (ring->count == 0 && ring->phase_count == 0 && ring->counters[0].name == NULL)
+            continue;
+        long first = ring->count > TRACE_EVENTS ? ring->count - TRACE_EVENTS : 0;
+        int phases = ring->phase_count < TRACE_PHASES ? ring->phase_count : TRACE_PHASES;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d", t, t);
+        if (first > 0)
+            fprintf(file, " (%ld earlier events overwritten)", first);
+        if (ring->phase_count > phases)
+            fprintf(file, " (%d phases dropped)", ring->phase_count - phases);
+        fprintf(file, "\"}}");
+        for (int k = 0; k < phases; k++)
+        {
+            writeEvent(file, &ring->phases[k], t);
+            written++;
+        }
+        for (long k = first; k < ring->count; k++)
+        {
+            writeEvent(file, &ring->events[k & (TRACE_EVENTS - 1)], t);
+            written++;
+        }
+        // Counters are summed over the run, so each is one sample at the end, per thread
+        for (int c = 0; c < TRACE_COUNTERS && ring->counters[c].name != NULL; c++)
+        {
+            fprintf(file, ",\n{\"name\":\"%s (thread %d)\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"ms\":%.3f,\"calls\":%ld}}",
+                    ring->counters[c].name, t, t, (now - trace_origin) * 1e6, ring->counters[c].seconds * 1e3, ring->counters[c].calls);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0)
+        return -1;
+    return written;
+}
+
+void traceFree(void)
+{
+    for (int t = 0; t < trace_threads; t++)
+    {
+        free(trace_rings[t].events);
+    }
+    free(trace_rings);
+    trace_rings = NULL;
+    trace_threads = 0;
+}
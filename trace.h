@@ -0,0 +1,136 @@
+/**
+ * @file trace.h
+ * @authors Camp Steiner, Jeff Luong
+ *
+ * Timeline tracing. Each OpenMP thread records the begin and end of named phases into its own
+ * ring of TRACE_EVENTS events, without locking; when a ring fills, its oldest events are
+ * overwritten. Phases that run once per program (loading, setup, checks) are opened with
+ * tracePhaseBegin instead and kept in a separate list that repeated phases cannot overwrite.
+ * Work too short and frequent for an event of its own is timed with traceNow and summed into a
+ * per-thread counter with traceAdd. traceWrite dumps everything as Chrome trace-event JSON for
+ * chrome://tracing or ui.perfetto.dev. Tracing is off until traceInit and then costs two clock
+ * reads per phase. Names must be string literals, since only the pointer is kept. Build a
+ * program with it by adding trace.c to its compile line.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <omp.h>
+
+// Events kept per thread (a power of two), one-shot phases and counters kept per thread, and
+// depth of nested phases that are recorded
+#define TRACE_EVENTS (1 << 16)
+#define TRACE_PHASES 64
+#define TRACE_COUNTERS 8
+#define TRACE_DEPTH 16
+
+typedef struct
+{
+    const char *name;
+    double start;
+    double end;
+} TraceEvent;
+
+typedef struct
+{
+    const char *name;
+    double seconds;
+    long calls;
+} TraceCounter;
+
+// One thread's ring, one-shot phases, counters and stack of open phases, padded so threads do
+// not share lines
+typedef struct
+{
+    TraceEvent *events;
+    long count; // events ever recorded; the ring holds the last TRACE_EVENTS
+    TraceEvent phases[TRACE_PHASES];
+    int phase_count; // one-shot phases ever recorded; the first TRACE_PHASES are kept
+    TraceCounter counters[TRACE_COUNTERS];
+    int depth;
+    const char *open_name[TRACE_DEPTH];
+    double open_start[TRACE_DEPTH];
+    char open_phase[TRACE_DEPTH];
+    char pad[64];
+} TraceRing;
+
+extern TraceRing *trace_rings;
+extern int trace_threads;
+
+// Turn tracing on for OpenMP threads 0 .. threads - 1
+void traceInit(int threads);
+
+// Write the rings as Chrome trace-event JSON; returns the number of events or -1
+long traceWrite(const char *path);
+
+void traceFree(void);
+
+// Sum seconds into the calling thread's counter of that name; counters past TRACE_COUNTERS
+// are dropped
+void traceAdd(const char *name, double seconds);
+
+static inline void traceOpen(const char *name, int phase)
+{
+    if (trace_rings == NULL)
+        return;
+    int t = omp_get_thread_num();
+    if (t >= trace_threads)
+        return;
+    TraceRing *ring = &trace_rings[t];
+    if (ring->depth < TRACE_DEPTH)
+    {
+        ring->open_name[ring->depth] = name;
+        ring->open_start[ring->depth] = omp_get_wtime();
+        ring->open_phase[ring->depth] = (char)phase;
+    }
+    ring->depth++;
+}
+
+// Open a phase that repeats, recorded in the ring
+static inline void traceBegin(const char *name)
+{
+    traceOpen(name, 0);
+}
+
+// Open a phase that runs once per program, recorded where the ring cannot overwrite it
+static inline void tracePhaseBegin(const char *name)
+{
+    traceOpen(name, 1);
+}
+
+// The clock when tracing is on, 0 otherwise, for timing work summed with traceAdd
+static inline double traceNow(void)
+{
+    return trace_rings != NULL ? omp_get_wtime() : 0;
+}
+
+static inline void traceEnd(void)
+{
+    if (trace_rings == NULL)
+        return;
+    int t = omp_get_thread_num();
+    if (t >= trace_threads)
+        return;
+    TraceRing *ring = &trace_rings[t];
+    if (ring->depth == 0)
+        return;
+    ring->depth--;
+    if (ring->depth >= TRACE_DEPTH)
+        return;
+    TraceEvent *event;
+    if (ring->open_phase[ring->depth])
+    {
+        if (ring->phase_count++ >= TRACE_PHASES)
+            return;
+        event = &ring->phases[ring->phase_count - 1];
+    }
+    else
+    {
+        event = &ring->events[ring->count++ & (TRACE_EVENTS - 1)];
+    }
+    event->name = ring->open_name[ring->depth];
+    event->start = ring->open_start[ring->depth];
+    event->end = omp_get_wtime();
+}
+
+#endif